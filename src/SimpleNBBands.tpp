@@ -0,0 +1,250 @@
+/**
+ * @file       SimpleNBBands.tpp
+ * @author     Henry Cheung
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2021 Henry Cheung
+ * @date       Oct 2021
+ */
+
+#ifndef SRC_SIMPLE_NB_BANDS_H_
+#define SRC_SIMPLE_NB_BANDS_H_
+
+#include "SimpleNBCommon.h"
+
+#define SIMPLE_NB_SUPPORT_BANDS
+
+// How long waitForAttach() tries the band of the last attach before it opens
+// up all bands again
+#if !defined(SIMPLE_NB_LOCKED_ATTACH_TIMEOUT)
+#define SIMPLE_NB_LOCKED_ATTACH_TIMEOUT 30000L
+#endif
+
+// Where the modem last attached, band 0 if not known
+typedef struct {
+  RadioTech rat    = RADIO_NONE;
+  uint8_t   band   = 0;
+  uint32_t  earfcn = 0;
+} AttachInfo_t;
+
+// The modem implements:
+//   bool setBandMaskImpl(RadioTech rat, const uint64_t mask[2]);
+//   bool getBandMaskImpl(RadioTech rat, uint64_t mask[2]);
+//   bool setScanSequenceImpl(RadioTech first, RadioTech second,
+//                            RadioTech third);
+//   bool getServingCellImpl(AttachInfo_t& info);
+// and hides bandsApplyNowImpl() if new bands only take effect after a restart.
+
+template <class modemType>
+class SimpleNBBands {
+ public:
+  /*
+   * Band functions
+   */
+  // Limits the bands searched for one radio technology, bands are given by
+  // their number (e.g. {3, 8, 20})
+  bool setBands(RadioTech rat, const uint8_t* bands, uint8_t count) {
+    uint64_t mask[2];
+    bandsToMask(bands, count, mask);
+    return setBandMask(rat, mask);
+  }
+  // Fills bands with the band numbers enabled for rat, returns how many
+  uint8_t getBands(RadioTech rat, uint8_t* bands, uint8_t max) {
+    uint64_t mask[2];
+    if (!getBandMask(rat, mask)) { return 0; }
+    return maskToBands(mask, bands, max);
+  }
+  // The same as masks, band n in bit n-1 of mask[0] for bands 1-64 and of
+  // mask[1] for bands 65-128
+  bool setBandMask(RadioTech rat, const uint64_t mask[2]) {
+    return thisModem().setBandMaskImpl(rat, mask);
+  }
+  bool getBandMask(RadioTech rat, uint64_t mask[2]) {
+    return thisModem().getBandMaskImpl(rat, mask);
+  }
+  // Sets the radio technologies to search and, where the modem can, their
+  // order; the ones not given are not searched
+  bool setScanSequence(RadioTech first, RadioTech second = RADIO_NONE,
+                       RadioTech third = RADIO_NONE) {
+    return thisModem().setScanSequenceImpl(first, second, third);
+  }
+  // Asks the modem for the band and EARFCN it is camped on
+  bool getServingCell(AttachInfo_t& info) {
+    return thisModem().getServingCellImpl(info);
+  }
+  // Where the last waitForAttach() attached, keep it somewhere that survives
+  // a reset and hand it back with setLastAttach() after the next boot
+  AttachInfo_t getLastAttach() {
+    return last_attach;
+  }
+  void setLastAttach(const AttachInfo_t& info) {
+    last_attach = info;
+  }
+  // Waits for registration like waitForRegistration(), but first searches
+  // only the band of the last attach, which skips the scan of all the other
+  // bands. If nothing is found within SIMPLE_NB_LOCKED_ATTACH_TIMEOUT all
+  // bands are searched again. The band mask is restored either way. Modems
+  // that only take new bands after a restart just wait.
+  bool waitForAttach(uint32_t timeout_ms = 60000L) {
+    uint32_t     startMillis = millis();
+    AttachInfo_t last        = last_attach;
+    bool         ok          = thisModem().isNetworkRegistered();
+
+    if (!ok && last.band && thisModem().bandsApplyNowImpl()) {
+      uint64_t saved[2];
+      if (getBandMask(last.rat, saved) && setBands(last.rat, &last.band, 1)) {
+        DBG("### Searching band", last.band, "first");
+        ok = thisModem().waitForRegistration(
+            SimpleNBMin(timeout_ms, (uint32_t)SIMPLE_NB_LOCKED_ATTACH_TIMEOUT));
+        setBandMask(last.rat, saved);
+      }
+    }
+    if (!ok) {
+      uint32_t spent = millis() - startMillis;
+      if (spent < timeout_ms) {
+        ok = thisModem().waitForRegistration(timeout_ms - spent);
+      }
+    }
+    if (ok) { getServingCell(last_attach); }
+    DBG("### Attach", ok ? "done" : "failed", "in", millis() - startMillis,
+        "ms");
+    return ok;
+  }
+
+  /*
+   * CRTP Helper
+   */
+ protected:
+  inline const modemType& thisModem() const {
+    return static_cast<const modemType&>(*this);
+  }
+  inline modemType& thisModem() {
+    return static_cast<modemType&>(*this);
+  }
+
+  /*
+   * Utilities
+   */
+ protected:
+  bool bandsApplyNowImpl() {
+    return true;
+  }
+
+  // Band masks have band n in bit n-1, mask[0] holds bands 1-64 and mask[1]
+  // bands 65-128
+  static void bandsToMask(const uint8_t* bands, uint8_t count,
+                          uint64_t mask[2]) {
+    mask[0] = mask[1] = 0;
+    for (uint8_t i = 0; i < count; i++) {
+      uint8_t b = bands[i] - 1;
+      if (b < 128) { mask[b / 64] |= (uint64_t)1 << (b % 64); }
+    }
+  }
+
+  static uint8_t maskToBands(const uint64_t mask[2], uint8_t* bands,
+                             uint8_t max) {
+    uint8_t n = 0;
+    for (uint8_t b = 0; b < 128 && n < max; b++) {
+      if (mask[b / 64] & ((uint64_t)1 << (b % 64))) { bands[n++] = b + 1; }
+    }
+    return n;
+  }
+
+  // Band numbers separated by commas, as the SIMCom modems list them
+  static String maskToList(const uint64_t mask[2]) {
+    String list;
+    for (uint8_t b = 0; b < 128; b++) {
+      if (!(mask[b / 64] & ((uint64_t)1 << (b % 64)))) { continue; }
+      if (list.length()) { list += ','; }
+      list += b + 1;
+    }
+    return list;
+  }
+
+  // Reads band numbers separated by commas, anything else is skipped
+  static void listToMask(const String& list, uint64_t mask[2]) {
+    mask[0] = mask[1] = 0;
+    int from          = 0;
+    while (from < (int)list.length()) {
+      int to = list.indexOf(',', from);
+      if (to < 0) { to = list.length(); }
+      long b = list.substring(from, to).toInt() - 1;
+      if (b >= 0 && b < 128) { mask[b / 64] |= (uint64_t)1 << (b % 64); }
+      from = to + 1;
+    }
+  }
+
+  // Hex without leading zeros or prefix, as the BG96 takes it
+  static String maskToHex(const uint64_t mask[2]) {
+    static const char hexDigits[] = "0123456789ABCDEF";
+    String res;
+    for (int8_t i = 31; i >= 0; i--) {
+      uint8_t nibble = (mask[i / 16] >> ((i % 16) * 4)) & 0x0F;
+      if (nibble || res.length() || i == 0) { res += hexDigits[nibble]; }
+    }
+    return res;
+  }
+
+  // Reads a hex mask with or without 0x in front
+  static void hexToMask(const String& hex, uint64_t mask[2]) {
+    mask[0] = mask[1] = 0;
+    for (unsigned i = 0; i < hex.length(); i++) {
+      char c = hex[i];
+      if (c == 'x' || c == 'X') {
+        mask[0] = mask[1] = 0;  // what came before was the 0
+        continue;
+      }
+      if (!isxdigit(c)) { continue; }
+      mask[1] = (mask[1] << 4) | (mask[0] >> 60);
+      mask[0] = (mask[0] << 4) | SimpleNBHexByte('0', c);
+    }
+  }
+
+  // Decimal, as Print can't do 64 bits on every core
+  static String u64ToString(uint64_t v) {
+    char  buf[21];
+    char* p = buf + sizeof(buf) - 1;
+    *p      = '\0';
+    do {
+      *--p = '0' + v % 10;
+      v /= 10;
+    } while (v);
+    return p;
+  }
+
+  static uint64_t stringToU64(const char* s) {
+    uint64_t v = 0;
+    while (*s == ' ') { s++; }
+    while (*s >= '0' && *s <= '9') { v = v * 10 + (*s++ - '0'); }
+    return v;
+  }
+
+  // Band of an LTE downlink EARFCN, 0 if it isn't one of the IoT bands
+  static uint8_t bandFromEarfcn(uint32_t earfcn) {
+    static const struct {
+      uint8_t  band;
+      uint32_t first;
+      uint32_t last;
+    } ranges[] = {{1, 0, 599},         {2, 600, 1199},      {3, 1200, 1949},
+                  {4, 1950, 2399},     {5, 2400, 2649},     {8, 3450, 3799},
+                  {12, 5010, 5179},    {13, 5180, 5279},    {14, 5280, 5379},
+                  {17, 5730, 5849},    {18, 5850, 5999},    {19, 6000, 6149},
+                  {20, 6150, 6449},    {25, 8040, 8689},    {26, 8690, 9039},
+                  {28, 9210, 9659},    {66, 66436, 67335},  {71, 68586, 68935},
+                  {85, 70366, 70545}};
+    for (uint8_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+      if (earfcn >= ranges[i].first && earfcn <= ranges[i].last) {
+        return ranges[i].band;
+      }
+    }
+    return 0;
+  }
+
+  static bool hasRadio(RadioTech rat, RadioTech first, RadioTech second,
+                       RadioTech third) {
+    return first == rat || second == rat || third == rat;
+  }
+
+  AttachInfo_t last_attach;
+};
+
+#endif  // SRC_SIMPLE_NB_BANDS_H_
@@ -16,6 +16,7 @@
 typedef SimpleNBSim7000                   SimpleNB;
 typedef SimpleNBSim7000::GsmClientSim7000 SimpleNBClient;
 typedef SimpleNBSim7000::GsmClientSecureSIM7000 SimpleNBClientSecure;
+typedef SimpleNBSim7000::GsmUdp                 SimpleNBUdp;
 
 #elif defined(SIMPLE_NB_MODEM_SIM7000SSL)
 #include "SimpleNBClientSIM7000SSL.h"
@@ -27,7 +28,7 @@ typedef SimpleNBSim7000SSL::GsmClientSecureSIM7000SSL SimpleNBClientSecure;
 #include "SimpleNBClientSIM7020.h"
 typedef SimpleNBSim7020                   SimpleNB;
 typedef SimpleNBSim7020::GsmClientSim7020 SimpleNBClient;
-// typedef TinyGsmSim7020::GsmClientSecureSim7020 TinyGsmClientSecure; TODO!
+typedef SimpleNBSim7020::GsmClientSecureSim7020 SimpleNBClientSecure;
 
 #elif defined(SIMPLE_NB_MODEM_SIM7070) || defined(SIMPLE_NB_MODEM_SIM7080) || \
     defined(SIMPLE_NB_MODEM_SIM7090)
@@ -35,24 +36,28 @@ typedef SimpleNBSim7020::GsmClientSim7020 SimpleNBClient;
 typedef SimpleNBSim7080                         SimpleNB;
 typedef SimpleNBSim7080::GsmClientSim7080       SimpleNBClient;
 typedef SimpleNBSim7080::GsmClientSecureSIM7080 SimpleNBClientSecure;
+typedef SimpleNBSim7080::GsmUdp                 SimpleNBUdp;
 
 #elif defined(SIMPLE_NB_MODEM_BG96)
 #include "SimpleNBClientBG96.h"
 typedef SimpleNBBG96                      SimpleNB;
 typedef SimpleNBBG96::GsmClientBG96       SimpleNBClient;
 typedef SimpleNBBG96::GsmClientSecureBG96 SimpleNBClientSecure;
+typedef SimpleNBBG96::GsmUdp              SimpleNBUdp;
 
 #elif defined(SIMPLE_NB_MODEM_UBLOX)
 #include "SimpleNBClientUBLOX.h"
 typedef SimpleNBUBLOX                       SimpleNB;
 typedef SimpleNBUBLOX::GsmClientUBLOX       SimpleNBClient;
 typedef SimpleNBUBLOX::GsmClientSecureUBLOX SimpleNBClientSecure;
+typedef SimpleNBUBLOX::GsmUdp               SimpleNBUdp;
 
 #elif defined(SIMPLE_NB_MODEM_SARAR4)
 #include "SimpleNBClientSaraR4.h"
 typedef SimpleNBSaraR4                    SimpleNB;
 typedef SimpleNBSaraR4::GsmClientSaraR4   SimpleNBClient;
 typedef SimpleNBSaraR4::GsmClientSecureR4 SimpleNBClientSecure;
+typedef SimpleNBSaraR4::GsmUdp            SimpleNBUdp;
 
 #elif defined(SIMPLE_NB_MODEM_XBEE)
 #define SIMPLE_NB_SUPPORT_WIFI
@@ -67,9 +72,14 @@ typedef SimpleNBSequansMonarch                          SimpleNB;
 typedef SimpleNBSequansMonarch::GsmClientSequansMonarch SimpleNBClient;
 typedef SimpleNBSequansMonarch::GsmClientSecureSequansMonarch
     SimpleNBClientSecure;
+typedef SimpleNBSequansMonarch::GsmUdp SimpleNBUdp;
 
 #else
 #error "Unsupported modules"
 #endif
 
+#if defined(SIMPLE_NB_SUPPORT_SCHEDULER)
+typedef SimpleNBScheduler<SimpleNB> SimpleNBUploadScheduler;
+#endif
+
 #endif  // SRC_SIMPLE_NB_CLIENT_H_
@@ -13,6 +13,8 @@
 // #pragma message("SimpleNB:  SimpleNBClientBG96")
 
 // #define SIMPLE_NB_DEBUG Serial
+// #define SIMPLE_NB_USE_HTTP
+// #define SIMPLE_NB_USE_MQTT
 
 #define SIMPLE_NB_MUX_COUNT 12
 #define SIMPLE_NB_BUFFER_READ_AND_CHECK_SIZE
@@ -23,10 +25,23 @@
 #include "SimpleNBModem.tpp"
 #include "SimpleNBSMS.tpp"
 #include "SimpleNBTCP.tpp"
+#include "SimpleNBUDP.tpp"
 #include "SimpleNBTemperature.tpp"
 #include "SimpleNBTime.tpp"
 #include "SimpleNBNTP.tpp"
 #include "SimpleNBSSL.tpp"
+#include "SimpleNBDNS.tpp"
+#include "SimpleNBBands.tpp"
+#include "SimpleNBPowerSaving.tpp"
+#include "SimpleNBRadioQuality.tpp"
+#include "SimpleNBScheduler.tpp"
+#include "SimpleNBContexts.tpp"
+#ifdef SIMPLE_NB_USE_HTTP
+#include "SimpleNBHttp.tpp"
+#endif
+#ifdef SIMPLE_NB_USE_MQTT
+#include "SimpleNBMqtt.tpp"
+#endif
 
 #define ACK_NL "\r\n"
 static const char ACK_OK[] SIMPLE_NB_PROGMEM    = "OK" ACK_NL;
@@ -48,6 +63,7 @@ enum RegStatus {
 
 class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
                     public SimpleNBTCP<SimpleNBBG96, SIMPLE_NB_MUX_COUNT>,
+                    public SimpleNBUDP<SimpleNBBG96, SIMPLE_NB_MUX_COUNT>,
                     public SimpleNBCalling<SimpleNBBG96>,
                     public SimpleNBSMS<SimpleNBBG96>,
                     public SimpleNBTime<SimpleNBBG96>,
@@ -55,9 +71,21 @@ class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
                     public SimpleNBGPS<SimpleNBBG96>,
                     public SimpleNBBattery<SimpleNBBG96>,
                     public SimpleNBSSL<SimpleNBBG96>,
-                    public SimpleNBTemperature<SimpleNBBG96> {
+                    public SimpleNBTemperature<SimpleNBBG96>,
+                    public SimpleNBDNS<SimpleNBBG96>,
+                    public SimpleNBBands<SimpleNBBG96>,
+                    public SimpleNBPowerSaving<SimpleNBBG96>,
+                    public SimpleNBRadioQuality<SimpleNBBG96>,
+#ifdef SIMPLE_NB_USE_HTTP
+                    public SimpleNBHttp<SimpleNBBG96>,
+#endif
+#ifdef SIMPLE_NB_USE_MQTT
+                    public SimpleNBMqtt<SimpleNBBG96>,
+#endif
+                    public SimpleNBContexts<SimpleNBBG96> {
   friend class SimpleNBModem<SimpleNBBG96>;
   friend class SimpleNBTCP<SimpleNBBG96, SIMPLE_NB_MUX_COUNT>;
+  friend class SimpleNBUDP<SimpleNBBG96, SIMPLE_NB_MUX_COUNT>;
   friend class SimpleNBCalling<SimpleNBBG96>;
   friend class SimpleNBSMS<SimpleNBBG96>;
   friend class SimpleNBTime<SimpleNBBG96>;
@@ -66,6 +94,17 @@ class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
   friend class SimpleNBBattery<SimpleNBBG96>;
   friend class SimpleNBSSL<SimpleNBBG96>;
   friend class SimpleNBTemperature<SimpleNBBG96>;
+  friend class SimpleNBDNS<SimpleNBBG96>;
+  friend class SimpleNBBands<SimpleNBBG96>;
+  friend class SimpleNBPowerSaving<SimpleNBBG96>;
+  friend class SimpleNBRadioQuality<SimpleNBBG96>;
+  friend class SimpleNBContexts<SimpleNBBG96>;
+#ifdef SIMPLE_NB_USE_HTTP
+  friend class SimpleNBHttp<SimpleNBBG96>;
+#endif
+#ifdef SIMPLE_NB_USE_MQTT
+  friend class SimpleNBMqtt<SimpleNBBG96>;
+#endif
 
   /*
    * Inner Client
@@ -103,11 +142,21 @@ class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
       SIMPLE_NB_YIELD();
       rx.clear();
       sock_connected = at->modemConnect(host, port, mux, false, timeout_s);
+      if (!sock_connected) { at->connectFailed(mux); }
       return sock_connected;
     }
 
     SIMPLE_NB_CLIENT_CONNECT_OVERRIDES
 
+    int connectAsync(const char* host, uint16_t port) override {
+      stop();
+      SIMPLE_NB_YIELD();
+      rx.clear();
+      sock_connected = false;
+      bool accepted = at->modemConnect(host, port, mux, false, 150, true);
+      return connectStarted(accepted, 150);
+    }
+
     void stop(uint32_t maxWaitMs) {
       uint32_t startMillis = millis();
       dumpModemBuffer(maxWaitMs);
@@ -151,6 +200,15 @@ class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
 
     SIMPLE_NB_CLIENT_CONNECT_OVERRIDES
 
+    int connectAsync(const char* host, uint16_t port) override {
+      stop();
+      SIMPLE_NB_YIELD();
+      rx.clear();
+      sock_connected = false;
+      bool accepted = at->modemConnect(host, port, mux, true, 150, true);
+      return connectStarted(accepted, 150);
+    }
+
     void stop(uint32_t maxWaitMs) {
       uint32_t startMillis = millis();
       dumpModemBuffer(maxWaitMs);
@@ -170,6 +228,7 @@ class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
  public:
   explicit SimpleNBBG96(Stream& stream) : stream(stream) {
     memset(sockets, 0, sizeof(sockets));
+    memset(udpSockets, 0, sizeof(udpSockets));
   }
 
   /*
@@ -186,21 +245,22 @@ class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
     if (waitResponse() != 1) { return false; }
 
 #ifdef SIMPLE_NB_DEBUG
-    sendAT(GF("+CMEE=2"));  // turn on verbose error codes
+    sendATSetting(1000L, GF("+CMEE=2"));  // turn on verbose error codes
 #else
-    sendAT(GF("+CMEE=0"));  // turn off error codes
+    sendATSetting(1000L, GF("+CMEE=0"));  // turn off error codes
 #endif
-    waitResponse();
 
     getModemName();
 
     // Disable time and time zone URC's
-    sendAT(GF("+CTZR=0"));
-    if (waitResponse(10000L) != 1) { return false; }
+    if (!sendATSetting(10000L, GF("+CTZR=0"))) { return false; }
 
     // Enable automatic time zone update
-    sendAT(GF("+CTZU=1"));
-    if (waitResponse(10000L) != 1) { return false; }
+    if (!sendATSetting(10000L, GF("+CTZU=1"))) { return false; }
+
+    // Report registration changes, with the serving cell, as they happen
+    enableRegistrationUrc(GF("+CEREG=2"));
+    enableRegistrationUrc(GF("+CREG=2"));
 
     SimStatus ret = getSimStatus();
     // if the sim isn't ready and a pin has been provided, try to unlock the sim
@@ -214,6 +274,14 @@ class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
     }
   }
 
+  // Warm start, the settings of the full init were saved with AT&W
+  bool fastStartImpl() {
+    if (!testAT()) { return false; }
+    return checkSettings(GF("+CMEE?;+CTZR?;+CTZU?;+CPIN?"),
+                         SIMPLE_NB_CMEE_REPLY, "+CTZR: 0", "+CTZU: 1",
+                         "+CPIN: READY");
+  }
+
   /*
    * Power functions
    */
@@ -251,24 +319,13 @@ class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
    */
  public:
   bool activateDataNetwork() {
-    sendAT(GF("+QIACT=1"));
-    if (waitResponse(150000L) != 1) { return false; }
-
-    // check if activation success? it returns +CGACT: <cid>,<state>
-    // <state> = 1, activated
-    sendAT(GF("+QIACT?"));
-    if (waitResponse(60000L, GF(ACK_NL "+QIACT:")) != 1) { return false; }
-    streamSkipUntil(',');
-    int16_t state = streamGetIntBefore(',');
-    waitResponse();
-    return state == 1;
+    // Nothing to do if the context is still up, e.g. after a warm restart
+    if (dataState() == 1 || queryDataActive()) { return true; }
+    return activateContextImpl(1);
   }
 
   bool deactivateDataNetwork() {
-    sendAT(GF("+QIDEACT=1"));  // Deactivate the bearer context
-    if (waitResponse(40000L) != 1) { return false; }
-
-    return true;
+    return deactivateContextImpl(1);
   }
 
   RegStatus getRegistrationStatus() {
@@ -290,6 +347,131 @@ class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
     return (s == REG_OK_HOME || s == REG_OK_ROAMING);
   }
 
+  /*
+   * Band functions
+   */
+ protected:
+  // CAT-M and NB-IoT bands are masks, the GSM setting is kept as it is
+  bool setBandMaskImpl(RadioTech rat, const uint64_t mask[2]) {
+    if (rat != RADIO_CATM && rat != RADIO_NBIOT) { return false; }
+    String   gsm;
+    uint64_t masks[2][2];
+    if (!getBandMasks(gsm, masks)) { return false; }
+    masks[rat == RADIO_NBIOT][0] = mask[0];
+    masks[rat == RADIO_NBIOT][1] = mask[1];
+    // AT+QCFG="band",<gsmbandval>,<emtcbandval>,<nbiotbandval>,<effect>
+    sendAT(GF("+QCFG=\"band\","), gsm, ',', maskToHex(masks[0]), ',',
+           maskToHex(masks[1]), GF(",1"));
+    return waitResponse() == 1;
+  }
+
+  bool getBandMaskImpl(RadioTech rat, uint64_t mask[2]) {
+    if (rat != RADIO_CATM && rat != RADIO_NBIOT) { return false; }
+    String   gsm;
+    uint64_t masks[2][2];
+    if (!getBandMasks(gsm, masks)) { return false; }
+    mask[0] = masks[rat == RADIO_NBIOT][0];
+    mask[1] = masks[rat == RADIO_NBIOT][1];
+    return true;
+  }
+
+  // +QCFG: "band",<gsmbandval>,<emtcbandval>,<nbiotbandval>, masks in hex
+  bool getBandMasks(String& gsm, uint64_t masks[2][2]) {
+    sendAT(GF("+QCFG=\"band\""));
+    if (waitResponse(GF("+QCFG: \"band\",")) != 1) { return false; }
+    gsm         = stream.readStringUntil(',');
+    String emtc = stream.readStringUntil(',');
+    String nb   = stream.readStringUntil('\n');
+    waitResponse();
+    gsm.replace("0x", "");
+    hexToMask(emtc, masks[0]);
+    hexToMask(nb, masks[1]);
+    return true;
+  }
+
+  bool setScanSequenceImpl(RadioTech first, RadioTech second,
+                           RadioTech third) {
+    bool gsm  = hasRadio(RADIO_GSM, first, second, third);
+    bool catm = hasRadio(RADIO_CATM, first, second, third);
+    bool nb   = hasRadio(RADIO_NBIOT, first, second, third);
+    if (!gsm && !catm && !nb) { return false; }
+    // The order as two digit codes, e.g. 0301 for NB-IoT then GSM
+    String seq;
+    RadioTech order[] = {first, second, third};
+    for (uint8_t i = 0; i < 3; i++) {
+      if (order[i] == RADIO_NONE) { continue; }
+      seq += '0';
+      seq += (int)order[i];
+    }
+    sendAT(GF("+QCFG=\"nwscanseq\","), seq, GF(",1"));
+    if (waitResponse() != 1) { return false; }
+    // 0 automatic, 1 GSM only, 3 LTE only
+    sendAT(GF("+QCFG=\"nwscanmode\","), !catm && !nb ? 1 : gsm ? 0 : 3,
+           GF(",1"));
+    if (waitResponse() != 1) { return false; }
+    if (!catm && !nb) { return true; }
+    // 0 CAT-M, 1 NB-IoT, 2 CAT-M and NB-IoT
+    sendAT(GF("+QCFG=\"iotopmode\","), catm && nb ? 2 : catm ? 0 : 1,
+           GF(",1"));
+    return waitResponse() == 1;
+  }
+
+  bool getServingCellImpl(AttachInfo_t& info) {
+    // +QNWINFO: "CAT-NB1","46011","LTE BAND 8",3734
+    sendAT(GF("+QNWINFO"));
+    if (waitResponse(GF("+QNWINFO:")) != 1) { return false; }
+    String line = stream.readStringUntil('\n');
+    waitResponse();
+    int band = line.indexOf("BAND ");
+    if (band < 0) { return false; }
+    info.rat    = line.indexOf("NB") >= 0 ? RADIO_NBIOT : RADIO_CATM;
+    info.band   = line.substring(band + 5).toInt();
+    info.earfcn = line.substring(line.indexOf(',', band) + 1).toInt();
+    return info.band != 0;
+  }
+
+  /*
+   * Radio quality functions
+   */
+ protected:
+  bool sampleRadioQualityImpl(RadioQuality_t& sample) {
+    // +QENG: "servingcell",<state>,"eMTC"|"NBIoT",<is_tdd>,<mcc>,<mnc>,
+    // <cellid>,<pcid>,<earfcn>,<band>,<ul_bw>,<dl_bw>,<tac>,<rsrp>,<rsrq>,
+    // <rssi>,<sinr>,<srxlev>
+    sendAT(GF("+QENG=\"servingcell\""));
+    if (waitResponse(GF("+QENG:")) != 1) { return false; }
+    String line = stream.readStringUntil('\n');
+    waitResponse();
+    if (csvField(line, 16).length() == 0) { return false; }
+    sample.rat    = line.indexOf("NBIoT") >= 0 ? RADIO_NBIOT : RADIO_CATM;
+    sample.cell   = strtoul(csvField(line, 6).c_str(), NULL, 16);
+    sample.earfcn = csvField(line, 8).toInt();
+    sample.band   = csvField(line, 9).toInt();
+    sample.rsrp   = csvField(line, 13).toFloat();
+    sample.rsrq   = csvField(line, 14).toFloat();
+    // In fifths of a dB from -20 dB
+    sample.sinr = csvField(line, 16).toFloat() / 5 - 20;
+    if (sample.rat == RADIO_NBIOT) {
+      // +QCFG: "celevel",<level>
+      sendAT(GF("+QCFG=\"celevel\""));
+      if (waitResponse(GF("+QCFG: \"celevel\",")) == 1) {
+        sample.ce_level = streamGetIntBefore('\n');
+        waitResponse();
+      }
+    }
+    return true;
+  }
+
+  /*
+   * Power saving functions
+   */
+ protected:
+  // PSM POWER DOWN comes unasked when the modem enters PSM, RDY when it
+  // boots again on waking up
+  bool psmUrcImpl(bool) {
+    return true;
+  }
+
   /*
    * Secure socket layer functions
    */
@@ -300,6 +482,235 @@ class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
     return true;
   }
 
+#ifdef SIMPLE_NB_USE_HTTP
+  /*
+   * HTTP functions
+   */
+ protected:
+  // There is no connection to open, the server goes with every request
+  bool httpConnectImpl() {
+    if (!sendATIndexedSetting(1000L, 1, GF("+QHTTPCFG=\"contextid\",1")) ||
+        !sendATIndexedSetting(1000L, 1, GF("+QHTTPCFG=\"responseheader\",1"))) {
+      return false;
+    }
+    if (!http_ssl) { return true; }
+    // SSL context 1, so it doesn't touch the one of the TCP clients
+    if (!sendATIndexedSetting(1000L, 1, GF("+QHTTPCFG=\"sslctxid\",1")) ||
+        !sendATIndexedSetting(1000L, 2, GF("+QSSLCFG=\"sslversion\",1,4"))) {
+      return false;
+    }
+    // <seclevel> 0: no check, with httpSetInsecure(); 1: the server is
+    // checked against the CA file on the modem
+    if (!http_ca.length()) {
+      return sendATIndexedSetting(1000L, 2, GF("+QSSLCFG=\"seclevel\",1,0"));
+    }
+    return sendATIndexedSetting(1000L, 2, GF("+QSSLCFG=\"cacert\",1,\""),
+                                http_ca, '"') &&
+           sendATIndexedSetting(1000L, 2, GF("+QSSLCFG=\"seclevel\",1,1"));
+  }
+
+  // Only GET and POST. With extra headers, or for a POST, the request is
+  // sent as a whole with +QHTTPCFG="requestheader",1. The response is
+  // streamed with +QHTTPREAD, httpRead() takes the body straight off the
+  // UART, so without flow control it has to be read without delay.
+  int httpSendImpl(HttpMethod method, const String& path, const uint8_t* body,
+                   size_t len, const char* content_type) {
+    bool post = method == HTTP_METHOD_POST;
+    if (!post && method != HTTP_METHOD_GET) { return -1; }
+    skipHttpBody();
+
+    String url = String(http_ssl ? "https://" : "http://") + http_host + ':' +
+                 http_port + path;
+    sendAT(GF("+QHTTPURL="), url.length(), GF(",80"));
+    if (waitResponse(GF("CONNECT")) != 1) { return -1; }
+    stream.print(url);
+    stream.flush();
+    if (waitResponse() != 1) { return -1; }
+
+    bool   raw = post || http_header_count;
+    String head;
+    if (raw) {
+      head = String(post ? "POST " : "GET ") + path + " HTTP/1.1\r\nHost: " +
+             http_host + "\r\n" + httpHeaderLines();
+      if (post) {
+        if (content_type) {
+          head += String("Content-Type: ") + content_type + "\r\n";
+        }
+        head += String("Content-Length: ") + len + "\r\n";
+      }
+      head += "\r\n";
+    }
+    if (!sendATIndexedSetting(1000L, 1, GF("+QHTTPCFG=\"requestheader\","),
+                              raw)) {
+      return -1;
+    }
+    if (post) {
+      sendAT(GF("+QHTTPPOST="), head.length() + len, GF(",80,80"));
+    } else if (raw) {
+      sendAT(GF("+QHTTPGET=80,"), head.length());
+    } else {
+      sendAT(GF("+QHTTPGET=80"));
+    }
+    if (raw) {
+      if (waitResponse(GF("CONNECT")) != 1) { return -1; }
+      stream.print(head);
+      if (post && len) { stream.write(body, len); }
+      stream.flush();
+    }
+    if (waitResponse() != 1) { return -1; }
+
+    // +QHTTPGET: <err>,<status>[,<length>] and the same for +QHTTPPOST
+    int8_t res;
+    if (post) {
+      res = waitResponse(SIMPLE_NB_HTTP_TIMEOUT, GF("+QHTTPPOST:"));
+    } else {
+      res = waitResponse(SIMPLE_NB_HTTP_TIMEOUT, GF("+QHTTPGET:"));
+    }
+    if (res != 1) { return -1; }
+    String line = stream.readStringUntil('\n');
+    int    c1   = line.indexOf(',');
+    int    c2   = line.indexOf(',', c1 + 1);
+    if (line.toInt() != 0 || c1 < 0) { return -1; }
+    int status  = line.substring(c1 + 1).toInt();
+    http_length = c2 < 0 ? -1 : line.substring(c2 + 1).toInt();
+
+    // AT+QHTTPREAD=<wait_time> answers CONNECT and then streams the
+    // response, headers first
+    sendAT(GF("+QHTTPREAD=80"));
+    if (waitResponse(GF("CONNECT")) != 1) { return -1; }
+    streamSkipUntil('\n');
+    http_reading  = true;
+    http_tail_len = 0;
+    readHttpHeaders();
+    return status;
+  }
+
+  // The body ends with OK and +QHTTPREAD: <err>, which is told apart from
+  // the body by holding back as many bytes as it is long
+  int httpReadImpl(uint8_t* buf, size_t size) {
+    static const char end[]       = "\r\nOK\r\n\r\n+QHTTPREAD:";
+    const uint8_t     endLen      = sizeof(end) - 1;
+    size_t            n           = 0;
+    uint32_t          startMillis = millis();
+    while (n < size && http_reading) {
+      if (http_tail_len == endLen) {
+        if (!memcmp(http_tail, end, endLen)) {
+          streamSkipUntil('\n');  // Skip the error code
+          http_reading  = false;
+          http_tail_len = 0;
+          break;
+        }
+        buf[n++] = http_tail[0];
+        memmove(http_tail, http_tail + 1, --http_tail_len);
+        continue;
+      }
+      if (!stream.available()) {
+        if (millis() - startMillis > 10000L) { http_reading = false; }
+        SIMPLE_NB_YIELD();
+        continue;
+      }
+      http_tail[http_tail_len++] = stream.read();
+      startMillis                = millis();
+    }
+    return n;
+  }
+
+  void httpCloseImpl() {
+    skipHttpBody();
+  }
+#endif
+
+#ifdef SIMPLE_NB_USE_MQTT
+  /*
+   * MQTT functions
+   */
+ protected:
+  // MQTT client 0, on context 1 unless setMqttContext() says otherwise. Every
+  // command is answered with OK first and then with a URC carrying the
+  // result.
+  bool mqttConnectImpl(const char* host, uint16_t port, bool ssl,
+                       const char* client_id, const char* user,
+                       const char* pwd) {
+    sendATIndexedSetting(1000L, 2, GF("+QMTCFG=\"version\",0,4"));  // 3.1.1
+    sendATIndexedSetting(1000L, 2, GF("+QMTCFG=\"pdpcid\",0,"),
+                         contextId(mqtt_context));
+    sendATIndexedSetting(1000L, 2, GF("+QMTCFG=\"keepalive\",0,"),
+                         mqtt_keepalive);
+    sendATIndexedSetting(1000L, 2, GF("+QMTCFG=\"session\",0,1"));
+    // Received messages as URCs with the payload length, so they may hold
+    // quotes and line ends; older firmware sends them without
+    sendAT(GF("+QMTCFG=\"recv/mode\",0,0,1"));
+    mqtt_sized = waitResponse() == 1;
+    // SSL context 2, so it touches neither the TCP clients' nor HTTP's
+    sendAT(GF("+QMTCFG=\"ssl\",0,"), ssl, GF(",2"));
+    waitResponse();
+    if (ssl) {
+      sendATIndexedSetting(1000L, 2, GF("+QSSLCFG=\"sslversion\",2,4"));
+      // <seclevel> 0: no check, with mqttSetInsecure(); 1: the broker is
+      // checked against the CA file
+      if (!mqtt_ca.length()) {
+        sendATIndexedSetting(1000L, 2, GF("+QSSLCFG=\"seclevel\",2,0"));
+      } else if (!sendATIndexedSetting(1000L, 2,
+                                       GF("+QSSLCFG=\"cacert\",2,\""),
+                                       mqtt_ca, '"') ||
+                 !sendATIndexedSetting(1000L, 2,
+                                       GF("+QSSLCFG=\"seclevel\",2,1"))) {
+        return false;
+      }
+    }
+    // +QMTOPEN: <client>,<result>, 2 if it is still open from before
+    sendAT(GF("+QMTOPEN=0,\""), host, GF("\","), port);
+    if (waitResponse() != 1) { return false; }
+    int res = mqttResult(GF("+QMTOPEN:"), 1);
+    if (res != 0 && res != 2) { return false; }
+    // +QMTCONN: <client>,<result>,<return code>
+    if (user) {
+      sendAT(GF("+QMTCONN=0,\""), client_id, GF("\",\""), user, GF("\",\""),
+             pwd ? pwd : "", '"');
+    } else {
+      sendAT(GF("+QMTCONN=0,\""), client_id, '"');
+    }
+    if (waitResponse() != 1 || mqttResult(GF("+QMTCONN:"), 1) != 0) {
+      sendAT(GF("+QMTCLOSE=0"));
+      waitResponse();
+      return false;
+    }
+    return true;
+  }
+
+  void mqttDisconnectImpl() {
+    sendAT(GF("+QMTDISC=0"));
+    if (waitResponse() == 1) { mqttResult(GF("+QMTDISC:"), 1); }
+  }
+
+  // AT+QMTPUBEX=<client>,<msgid>,<qos>,<retain>,"<topic>",<length>, the
+  // payload follows the prompt; +QMTPUBEX: <client>,<msgid>,<result>
+  bool mqttPublishImpl(const char* topic, const uint8_t* payload, size_t len,
+                       uint8_t qos, bool retain) {
+    sendAT(GF("+QMTPUBEX=0,"), qos ? nextMqttMsgId() : 0, ',', qos, ',',
+           retain, GF(",\""), topic, GF("\","), (uint16_t)len);
+    if (waitResponse(GF(">")) != 1) { return false; }
+    stream.write(payload, len);
+    stream.flush();
+    if (waitResponse(10000L) != 1) { return false; }
+    return mqttResult(GF("+QMTPUBEX:"), 2) == 0;
+  }
+
+  // +QMTSUB: <client>,<msgid>,<result>,<granted qos>
+  bool mqttSubscribeImpl(const char* topic, uint8_t qos) {
+    sendAT(GF("+QMTSUB=0,"), nextMqttMsgId(), GF(",\""), topic, GF("\","),
+           qos);
+    if (waitResponse() != 1) { return false; }
+    return mqttResult(GF("+QMTSUB:"), 2) == 0;
+  }
+
+  bool mqttUnsubscribeImpl(const char* topic) {
+    sendAT(GF("+QMTUNS=0,"), nextMqttMsgId(), GF(",\""), topic, '"');
+    if (waitResponse() != 1) { return false; }
+    return mqttResult(GF("+QMTUNS:"), 2) == 0;
+  }
+#endif
+
   /*
    * GPRS functions
    */
@@ -340,6 +751,58 @@ class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
     return true;
   }
 
+  /*
+   * Data context functions
+   */
+ protected:
+  bool defineContextImpl(uint8_t cid, const char* apn, const char* user,
+                         const char* pwd) {
+    // AT+QICSGP=<contextID>,<context_type>,<APN>,<username>,<password>,
+    // <authentication>
+    // <context_type> 1: IPv4
+    // <authentication> 0: None, 3: PAP or CHAP
+    bool auth = user && strlen(user) > 0;
+    sendAT(GF("+QICSGP="), cid, GF(",1,\""), apn, GF("\",\""),
+           auth ? user : "", GF("\",\""), auth && pwd ? pwd : "", GF("\","),
+           auth ? 3 : 0);
+    return waitResponse() == 1;
+  }
+
+  bool activateContextImpl(uint8_t cid) {
+    sendAT(GF("+QIACT="), cid);
+    if (waitResponse(150000L) != 1) { return false; }
+    String ip;
+    return queryContextImpl(cid, ip);
+  }
+
+  bool deactivateContextImpl(uint8_t cid) {
+    sendAT(GF("+QIDEACT="), cid);  // Deactivate the bearer context
+    if (waitResponse(40000L) != 1) { return false; }
+    setPdpState(cid, false);
+    return true;
+  }
+
+  // +QIACT: <cid>,<state>,<type>,"<address>" is listed for every active
+  // context, none at all if none is
+  bool queryContextImpl(uint8_t cid, String& ip) {
+    bool active = false;
+    sendAT(GF("+QIACT?"));
+    while (waitResponse(GF("+QIACT:"), GFP(ACK_OK), GFP(ACK_ERROR)) == 1) {
+      int8_t idx = streamGetIntBefore(',');
+      bool   up  = streamGetIntBefore(',') == 1;
+      streamSkipUntil('"');
+      String addr = stream.readStringUntil('"');
+      streamSkipUntil('\n');
+      if (idx == cid) {
+        active = up;
+        ip     = addr;
+      }
+      if (idx > 0) { setPdpState(idx, up); }
+    }
+    if (!active) { setPdpState(cid, false); }
+    return active;
+  }
+
   /*
    * SIM card functions
    */
@@ -518,13 +981,59 @@ class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
     return res;
   }
 
+  /*
+   * DNS functions
+   */
+ protected:
+  bool resolveImpl(const char* host, int8_t cid, String& ip, uint32_t& ttl_s,
+                   uint32_t timeout_ms) {
+    // AT+QIDNSGIP=<contextID>,<hostname>, the answer comes as URCs
+    // +QIURC: "dnsgip",<err>,<IP_count>,<DNS_ttl>
+    // +QIURC: "dnsgip",<hostIPaddr> for each address
+    sendAT(GF("+QIDNSGIP="), contextId(cid), GF(",\""), host, '"');
+    if (waitResponse() != 1) { return false; }
+    bool     gotHeader   = false;
+    uint32_t startMillis = millis();
+    while (millis() - startMillis < timeout_ms) {
+      if (waitResponse(timeout_ms - (millis() - startMillis),
+                       GF(ACK_NL "+QIURC:")) != 1) {
+        return false;
+      }
+      streamSkipUntil('\"');
+      String urc = stream.readStringUntil('\"');
+      streamSkipUntil(',');
+      if (urc != "dnsgip") {
+        // The sockets' URCs come through here while waiting, don't lose them
+        parseSocketUrc(urc);
+        continue;
+      }
+      String res = stream.readStringUntil('\n');
+      if (!gotHeader) {
+        if (res.toInt() != 0) { return false; }
+        ttl_s     = res.substring(res.lastIndexOf(',') + 1).toInt();
+        gotHeader = true;
+      } else {
+        // Only the first address is used, the rest end up unhandled
+        res.replace("\"", "");
+        res.trim();
+        ip = res;
+        return ip.length() > 0;
+      }
+    }
+    return false;
+  }
+
   /*
    * Client related functions
    */
  protected:
-  bool modemConnect(const char* host, uint16_t port, uint8_t mux, bool ssl = false, int timeout_s = 150) {
+  // With async set this returns once the open command is accepted, the
+  // +QIOPEN/+QSSLOPEN URC then completes the socket in waitResponse()
+  bool modemConnect(const char* host, uint16_t port, uint8_t mux,
+                    bool ssl = false, int timeout_s = 150, bool async = false) {
 
     uint32_t timeout_ms = ((uint32_t)timeout_s) * 1000;
+    int16_t  res;
     _ssl = ssl;
 
     if (_ssl) {
@@ -565,19 +1074,24 @@ class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
       //               0 Buffer access mode
       //               1 Direct push mode
       //               2 Transparent mode
-      sendAT(GF("+QSSLOPEN=1,0,"), mux, GF(",\""), host, GF("\","), port, GF(",0"));
-      waitResponse();
-      if (waitResponse(timeout_ms, GF(ACK_NL "+QSSLOPEN:")) != 1) { return false; }
+      sendAT(GF("+QSSLOPEN="), contextId(sockets[mux]->context), GF(",0,"), mux,
+             GF(",\""), host, GF("\","), port, GF(",0"));
+      if (waitResponse() != 1) { return false; }
+      if (async) { return true; }
+      res = waitOpenResult(mux, timeout_ms, GF(ACK_NL "+QSSLOPEN:"));
     }
     // for non SSL connection
     else {
       // <PDPcontextID>(1-16), <connectID>(0-11),
       // "TCP/UDP/TCP LISTENER/UDPSERVICE", "<IP_address>/<domain_name>",
       // <remote_port>,<local_port>,<access_mode>(0-2; 0=buffer)
-      sendAT(GF("+QIOPEN=1,"), mux, GF(",\""), GF("TCP"), GF("\",\""), host,
-             GF("\","), port, GF(",0,0"));
-      waitResponse();
-      if (waitResponse(timeout_ms, GF(ACK_NL "+QIOPEN:")) != 1) { return false; }
+      sendAT(GF("+QIOPEN="), contextId(sockets[mux]->context), ',', mux,
+             GF(",\""), GF("TCP"), GF("\",\""),
+             connectHost(host, mux, sockets[mux]->context), GF("\","), port,
+             GF(",0,0"));
+      if (waitResponse() != 1) { return false; }
+      if (async) { return true; }
+      res = waitOpenResult(mux, timeout_ms, GF(ACK_NL "+QIOPEN:"));
     }
 
     // For Non-SSL, return data is +QIOPEN: <clientID>,<result>
@@ -585,14 +1099,13 @@ class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
     // <result> 0: Success
     // If ERROR is returned after executing SSL AT commands, the details of error
     // can be queried with AT+QIGETERROR.
-    if (streamGetIntBefore(',') != mux) { return false; }
-    // Read status
-    int8_t res = streamGetIntBefore('\n');
+    if (res < 0) { return false; }
     waitResponse();
     return 0 == res;
   }
 
   int16_t modemSend(const void* buff, size_t len, uint8_t mux) {
+    applyReleaseAssist(GF("+QCFG=\"rai\","));
     if (_ssl) {
       sendAT(GF("+QSSLSEND="), mux, ',', (uint16_t) len);
     }
@@ -685,6 +1198,171 @@ class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
     return 2 == res;
   }
 
+  // A "UDP SERVICE" socket is not tied to a peer, each datagram carries its
+  // own destination and is read back with its sender
+  bool modemUdpBegin(uint8_t mux, uint16_t localPort) {
+    // AT+QIOPEN=<PDPcontextID>,<connectID>,"UDP SERVICE","127.0.0.1",0,
+    // <local_port>,<access_mode>(0=buffer)
+    sendAT(GF("+QIOPEN="), contextId(udpSockets[mux]->context), ',', mux,
+           GF(",\"UDP SERVICE\",\"127.0.0.1\",0,"),
+           localPort, GF(",0"));
+    if (waitResponse() != 1) { return false; }
+    int16_t res = waitOpenResult(mux, 15000L, GF(ACK_NL "+QIOPEN:"));
+    if (res < 0) { return false; }
+    waitResponse();
+    return 0 == res;
+  }
+
+  // The modem only takes an IP address for the remote, names are resolved
+  size_t modemUdpSend(uint8_t mux, const char* host, uint16_t port,
+                      const uint8_t* buff, size_t len) {
+    String ip = resolve(host, 15000L, udpSockets[mux]->context);
+    if (!ip.length()) { return 0; }
+    applyReleaseAssist(GF("+QCFG=\"rai\","));
+    // AT+QISEND=<connectID>,<send_length>,<remoteIP>,<remote_port>
+    sendAT(GF("+QISEND="), mux, ',', (uint16_t)len, GF(",\""), ip, GF("\","),
+           port);
+    if (waitResponse(GF(">")) != 1) { return 0; }
+    stream.write(buff, len);
+    stream.flush();
+    if (waitResponse(GF(ACK_NL "SEND OK")) != 1) { return 0; }
+    return len;
+  }
+
+  void modemUdpRead(uint8_t mux) {
+    // Each AT+QIRD on a "UDP SERVICE" socket returns a single datagram
+    // +QIRD: <read_actual_length>,<remoteIP>,<remote_port><CR><LF><data>
+    for (int i = 0; i < SIMPLE_NB_UDP_MAX_DATAGRAMS; i++) {
+      sendAT(GF("+QIRD="), mux);
+      if (waitResponse(GF("+QIRD:")) != 1) { return; }
+      int16_t len = streamGetIntBefore(',');
+      if (len <= 0) {
+        streamSkipUntil('\n');
+        waitResponse();
+        return;
+      }
+      streamSkipUntil('"');
+      String    remote = stream.readStringUntil('"');
+      IPAddress ip;
+      ip.fromString(remote.c_str());
+      streamSkipUntil(',');
+      uint16_t rport = streamGetIntBefore('\n');
+      moveDatagramFromStreamToFifo(mux, len, ip, rport);
+      waitResponse();
+      DBG("### UDP READ:", len, "from", remote, rport);
+    }
+  }
+
+  void modemUdpStop(uint8_t mux) {
+    sendAT(GF("+QICLOSE="), mux);
+    waitResponse(15000L);
+  }
+
+#ifdef SIMPLE_NB_USE_HTTP
+  // The streamed response starts with the status line and the headers, the
+  // body follows the blank line after them
+  void readHttpHeaders() {
+    stream.readStringUntil('\n');  // Skip the status line
+    for (;;) {
+      String line = stream.readStringUntil('\n');
+      if (line.length() <= 1) { break; }  // the blank line, or a time-out
+      http_response_headers += line + '\n';
+    }
+  }
+
+  // Reads what is left of a streamed response, so it doesn't end up in the
+  // replies to the next commands
+  void skipHttpBody() {
+    uint8_t buf[32];
+    while (http_reading && httpReadImpl(buf, sizeof(buf)) > 0) {}
+    http_reading  = false;
+    http_tail_len = 0;
+  }
+#endif
+
+  // Handles the rest of a +QIURC: "<urc>", line from the modem
+  void parseSocketUrc(const String& urc) {
+    if (urc == "pdpdeact") {
+      int8_t cid = streamGetIntBefore('\n');
+      DBG("### URC DEACT:", cid);
+      if (cid > 0) { setPdpState(cid, false); }
+    } else if (urc == "recv") {
+      int8_t mux = streamGetIntBefore('\n');
+      DBG("### URC RECV:", mux);
+      if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && sockets[mux]) {
+        sockets[mux]->got_data = true;
+      }
+      if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && udpSockets[mux]) {
+        udpSockets[mux]->got_data = true;
+      }
+    } else if (urc == "closed") {
+      int8_t mux = streamGetIntBefore('\n');
+      DBG("### URC CLOSE:", mux);
+      if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && sockets[mux]) {
+        sockets[mux]->sock_connected = false;
+      }
+      if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && udpSockets[mux]) {
+        udpSockets[mux]->sock_open = false;
+      }
+    } else {
+      streamSkipUntil('\n');
+    }
+  }
+
+#ifdef SIMPLE_NB_USE_MQTT
+  // Waits for the result URC of an MQTT command and returns its field n,
+  // -1 if it didn't come
+  int mqttResult(GsmConstStr urc, uint8_t n) {
+    if (waitResponse(SIMPLE_NB_MQTT_TIMEOUT, urc) != 1) { return -1; }
+    int fields[4];
+    if (SimpleNBParseInts(stream.readStringUntil('\n'), fields, 4) <= n) {
+      return -1;
+    }
+    return fields[n];
+  }
+
+  uint16_t nextMqttMsgId() {
+    if (++mqtt_msg_id == 0) { mqtt_msg_id = 1; }
+    return mqtt_msg_id;
+  }
+
+  // +QMTRECV: <client>,<msgid>,"<topic>",<length>,"<payload>", without the
+  // length on older firmware
+  void parseMqttMessage() {
+    streamSkipUntil('"');
+    String topic = stream.readStringUntil('"');
+    streamSkipUntil(',');
+    if (mqtt_sized) {
+      int16_t len = streamGetIntBefore(',');
+      streamSkipUntil('"');
+      readMqttMessage(topic, SimpleNBMax(len, (int16_t)0));
+      streamSkipUntil('\n');
+      return;
+    }
+    streamSkipUntil('"');
+    String msg = stream.readStringUntil('\n');
+    msg.trim();
+    if (msg.endsWith("\"")) { msg.remove(msg.length() - 1); }
+    queueMqttMessage(topic, (const uint8_t*)msg.c_str(), msg.length());
+  }
+#endif
+
+  bool queryDataActive() {
+    String ip;
+    return queryContextImpl(1, ip);
+  }
+
+  // Context 1 is the one activateDataNetwork() brings up
+  void setPdpState(uint8_t cid, bool active) {
+    setContextState(cid, active);
+    if (cid == 1) { setDataActive(active); }
+  }
+
+  // Context a socket was bound to with setContext(), 1 if none
+  static uint8_t contextId(int8_t context) {
+    return context < 0 ? 1 : context;
+  }
+
   /*
    * Utilities
    */
@@ -736,28 +1414,45 @@ class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
         } else if (r5 && data.endsWith(r5)) {
           index = 5;
           goto finish;
+        } else if (handleRegistrationUrc(data)) {
+          data = "";
+#ifdef SIMPLE_NB_USE_MQTT
+        } else if (data.endsWith(GF("+QMTRECV:"))) {
+          parseMqttMessage();
+          data = "";
+          DBG("### MQTT message received");
+        } else if (data.endsWith(GF("+QMTSTAT:"))) {
+          // +QMTSTAT: <client>,<err>, the session with the broker is lost
+          streamSkipUntil('\n');
+          setMqttState(false);
+          data = "";
+#endif
+        } else if (data.endsWith(GF("PSM POWER DOWN"))) {
+          setPsmState(true);
+          data = "";
+        } else if (data.endsWith(GF("RDY" ACK_NL))) {
+          // RDY and APP RDY come with every boot, leaving PSM included, the
+          // modem lost whatever was set. That takes net.data and
+          // net.contexts back to not known too, so isGprsConnected() and
+          // isContextActive() ask the modem again instead of answering from
+          // the state before the reboot.
+          bool psm = net.psm;
+          clearSettingsShadow();
+          if (psm) { setPsmState(false); }
+          data = "";
+        } else if (data.endsWith(GF(ACK_NL "+QIOPEN:")) ||
+                   data.endsWith(GF(ACK_NL "+QSSLOPEN:"))) {
+          // Outcome of an asynchronous open, +QIOPEN: <connectID>,<err>
+          int8_t  mux = streamGetIntBefore(',');
+          int16_t err = streamGetIntBefore('\n');
+          asyncOpenDone(mux, 0 == err);
+          data = "";
+          DBG("### URC OPEN:", mux, err);
         } else if (data.endsWith(GF(ACK_NL "+QIURC:")) || data.endsWith(GF(ACK_NL "+QSSLURC:"))) {
           streamSkipUntil('\"');
           String urc = stream.readStringUntil('\"');
           streamSkipUntil(',');
-          if (urc == "pdpdeact") {
-            DBG("### URC DEACT:", streamGetIntBefore('\n'));
-          } else if (urc == "recv") {
-            int8_t mux = streamGetIntBefore('\n');
-            DBG("### URC RECV:", mux);
-            if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && sockets[mux]) {
-              sockets[mux]->got_data = true;
-            }
-          } else if (urc == "closed") {
-            int8_t mux = streamGetIntBefore('\n');
-            DBG("### URC CLOSE:", mux);
-            if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && sockets[mux]) {
-              sockets[mux]->sock_connected = false;
-            }
-          } else {
-            streamSkipUntil('\n');
-          }
-
+          parseSocketUrc(urc);
           data = "";
         }
       }
@@ -803,9 +1498,19 @@ class SimpleNBBG96 : public SimpleNBModem<SimpleNBBG96>,
 
  protected:
   GsmClientBG96* sockets[SIMPLE_NB_MUX_COUNT];
+  GsmUdp*        udpSockets[SIMPLE_NB_MUX_COUNT];
   String         certificates[SIMPLE_NB_MUX_COUNT];
   uint8_t        _ssl = 0;
   const char*    gsmNL = ACK_NL;
+#ifdef SIMPLE_NB_USE_HTTP
+  bool           http_reading = false;  // a response is being streamed
+  char           http_tail[20];  // body bytes held back, see httpReadImpl()
+  uint8_t        http_tail_len = 0;
+#endif
+#ifdef SIMPLE_NB_USE_MQTT
+  uint16_t       mqtt_msg_id = 0;
+  bool           mqtt_sized  = false;  // +QMTRECV carries the length
+#endif
 };
 
 #endif  // SRC_SIMPLE_NB_CLIENTBG96_H_
@@ -19,18 +19,31 @@
 
 #include "SimpleNBClientSIM70xx.h"
 #include "SimpleNBTCP.tpp"
+#include "SimpleNBUDP.tpp"
 #include "SimpleNBGPS.tpp"
 #include "SimpleNBSSL.tpp"
+#include "SimpleNBBands.tpp"
+#include "SimpleNBPowerSaving.tpp"
+#include "SimpleNBRadioQuality.tpp"
+#include "SimpleNBScheduler.tpp"
 
 class SimpleNBSim7000
   : public SimpleNBSim70xx<SimpleNBSim7000>,
     public SimpleNBTCP<SimpleNBSim7000, SIMPLE_NB_MUX_COUNT>,
+    public SimpleNBUDP<SimpleNBSim7000, SIMPLE_NB_MUX_COUNT>,
     public SimpleNBGPS<SimpleNBSim7000>,
-    public SimpleNBSSL<SimpleNBSim7000> {
+    public SimpleNBSSL<SimpleNBSim7000>,
+    public SimpleNBBands<SimpleNBSim7000>,
+    public SimpleNBPowerSaving<SimpleNBSim7000>,
+    public SimpleNBRadioQuality<SimpleNBSim7000> {
   friend class SimpleNBSim70xx<SimpleNBSim7000>;
   friend class SimpleNBTCP<SimpleNBSim7000, SIMPLE_NB_MUX_COUNT>;
+  friend class SimpleNBUDP<SimpleNBSim7000, SIMPLE_NB_MUX_COUNT>;
   friend class SimpleNBGPS<SimpleNBSim7000>;
   friend class SimpleNBSSL<SimpleNBSim7000>;
+  friend class SimpleNBBands<SimpleNBSim7000>;
+  friend class SimpleNBPowerSaving<SimpleNBSim7000>;
+  friend class SimpleNBRadioQuality<SimpleNBSim7000>;
 
   /*
    * Inner Client
@@ -69,10 +82,19 @@ class SimpleNBSim7000
       SIMPLE_NB_YIELD();
       rx.clear();
       sock_connected = at->modemConnect(host, port, mux, false, timeout_s);
+      if (!sock_connected) { at->connectFailed(mux); }
       return sock_connected;
     }
     SIMPLE_NB_CLIENT_CONNECT_OVERRIDES
 
+    int connectAsync(const char* host, uint16_t port) override {
+      SIMPLE_NB_YIELD();
+      rx.clear();
+      sock_connected = false;
+      bool accepted = at->modemConnect(host, port, mux, false, 75, true);
+      return connectStarted(accepted, 75);
+    }
+
     void stop(uint32_t maxWaitMs) {
       dumpModemBuffer(maxWaitMs);
       at->sendAT(GF("+CIPCLOSE="), mux);
@@ -125,6 +147,7 @@ class SimpleNBSim7000
   explicit SimpleNBSim7000(Stream& stream)
       : SimpleNBSim70xx<SimpleNBSim7000>(stream) {
     memset(sockets, 0, sizeof(sockets));
+    memset(udpSockets, 0, sizeof(udpSockets));
   }
 
   /*
@@ -141,17 +164,15 @@ class SimpleNBSim7000
     if (waitResponse() != 1) { return false; }
 
 #ifdef SIMPLE_NB_DEBUG
-    sendAT(GF("+CMEE=2"));  // turn on verbose error codes
+    sendATSetting(1000L, GF("+CMEE=2"));  // turn on verbose error codes
 #else
-    sendAT(GF("+CMEE=0"));  // turn off error codes
+    sendATSetting(1000L, GF("+CMEE=0"));  // turn off error codes
 #endif
-    waitResponse();
 
     getModemName();
 
     // Enable Local Time Stamp for getting network time
-    sendAT(GF("+CLTS=1"));
-    if (waitResponse(10000L) != 1) { return false; }
+    if (!sendATSetting(10000L, GF("+CLTS=1"))) { return false; }
 
     // Enable battery check
     // This command return +CME ERROR: Call index error
@@ -159,6 +180,10 @@ class SimpleNBSim7000
     // sendAT(GF("+CBATCHK=1"));
     // if (waitResponse() != 1) { return false; }
 
+    // Report registration changes, with the serving cell, as they happen
+    enableRegistrationUrc(GF("+CEREG=2"));
+    enableRegistrationUrc(GF("+CGREG=2"));
+
     SimStatus ret = getSimStatus();
     // if the sim isn't ready and a pin has been provided, try to unlock the sim
     if (ret != SIM_READY && pin != NULL && strlen(pin) > 0) {
@@ -171,6 +196,13 @@ class SimpleNBSim7000
     }
   }
 
+  // Warm start, the settings of the full init were saved with AT&W
+  bool fastStartImpl() {
+    if (!testAT()) { return false; }
+    return checkSettings(GF("+CMEE?;+CLTS?;+CPIN?"),
+                         SIMPLE_NB_CMEE_REPLY, "+CLTS: 1", "+CPIN: READY");
+  }
+
   /*
    * Power functions
    */
@@ -440,8 +472,10 @@ protected:
    * Client related functions
    */
  protected:
+  // With async set this returns once the open command is accepted, the
+  // "<n>, CONNECT OK" URC then completes the socket in waitResponse()
   bool modemConnect(const char* host, uint16_t port, uint8_t mux,
-                    bool ssl = false, int timeout_s = 75) {
+                    bool ssl = false, int timeout_s = 75, bool async = false) {
 
     uint32_t timeout_ms = ((uint32_t)timeout_s) * 1000;
 
@@ -450,13 +484,38 @@ protected:
       return false;
     }
 
-    sendAT(GF("+CIPSTART="), mux, GF(",\"TCP\",\""), host, GF("\",\""), port, GF("\""));
-    return (1 == waitResponse(timeout_ms, GF("CONNECT OK" ACK_NL),
-              GF("CONNECT FAIL" ACK_NL),
-              GF("ALREADY CONNECT" ACK_NL),
-              GF("ERROR" ACK_NL),
-              GF("CLOSE OK" ACK_NL))
-            );
+    sendAT(GF("+CIPSTART="), mux, GF(",\"TCP\",\""), connectHost(host, mux, -1), GF("\",\""), port, GF("\""));
+    if (async) { return waitResponse() == 1; }
+    return waitConnectResult(mux, timeout_ms);
+  }
+
+  // Waits for "<mux>, CONNECT OK" or the failure of the open on socket mux.
+  // The outcomes of sockets opening with connectAsync() meanwhile go to
+  // asyncOpenDone().
+  bool waitConnectResult(uint8_t mux, uint32_t timeout_ms) {
+    uint32_t startMillis = millis();
+    for (;;) {
+      uint32_t elapsed = millis() - startMillis;
+      if (elapsed >= timeout_ms) { return false; }
+      String data;
+      int8_t res = waitResponse(timeout_ms - elapsed, data,
+                                GF("CONNECT OK" ACK_NL),
+                                GF("CONNECT FAIL" ACK_NL),
+                                GF("ALREADY CONNECT" ACK_NL),
+                                GF("ERROR" ACK_NL), GF("CLOSE OK" ACK_NL));
+      if (res < 1 || res > 3) { return false; }
+      int8_t id = muxBefore(data, res == 1 ? 12 : res == 2 ? 14 : 17);
+      if (id == mux) { return res == 1; }
+      if (res != 3) { asyncOpenDone(id, res == 1); }
+    }
+  }
+
+  // Socket number of the "<n>, <reply>" at the end of data, the reply being
+  // len long
+  static int8_t muxBefore(const String& data, uint8_t len) {
+    int nl    = data.lastIndexOf(ACK_NL, data.length() - len);
+    int start = nl < 0 ? 0 : nl + 2;
+    return data.substring(start, data.indexOf(',', start)).toInt();
   }
 
   int16_t modemSend(const void* buff, size_t len, uint8_t mux) {
@@ -491,28 +550,21 @@ protected:
     // SRGD NOTE:  Contrary to above (which is copied from AT command manual)
     // this is actually be the number of bytes that will be remaining in the
     // buffer after the read.
-    for (int i = 0; i < len_requested; i++) {
-      uint32_t startMillis = millis();
 #ifdef SIMPLE_NB_USE_HEX
-      while (stream.available() < 2 &&
-             (millis() - startMillis < sockets[mux]->_timeout)) {
-        SIMPLE_NB_YIELD();
-      }
-      char buf[4] = {
-          0,
-      };
-      buf[0] = stream.read();
-      buf[1] = stream.read();
-      char c = strtol(buf, NULL, 16);
+    SimpleNBReadHexToFifo(stream, sockets[mux],
+                          SimpleNBMax(len_requested, (int16_t)0) * 2,
+                          sockets[mux]->_timeout);
 #else
+    for (int i = 0; i < len_requested; i++) {
+      uint32_t startMillis = millis();
       while (!stream.available() &&
              (millis() - startMillis < sockets[mux]->_timeout)) {
         SIMPLE_NB_YIELD();
       }
       char c = stream.read();
-#endif
-      sockets[mux]->rx.put(c);
+      sockets[mux]->put(c);
     }
+#endif
     // DBG("### READ:", len_requested, "from", mux);
     // sockets[mux]->sock_available = modemGetAvailable(mux);
     sockets[mux]->sock_available = len_confirmed;
@@ -546,6 +598,69 @@ protected:
     return 1 == res;
   }
 
+  // UDP connections are opened towards a single peer, endPacket() (re)opens
+  // the connection whenever the destination changes
+  bool modemUdpBegin(uint8_t mux, uint16_t localPort) {
+    if (localPort) {
+      // AT+CLPORT=<n>,<mode>,<port>
+      sendAT(GF("+CLPORT="), mux, GF(",\"UDP\","), localPort);
+      if (waitResponse() != 1) { return false; }
+    }
+    return true;
+  }
+
+  size_t modemUdpSend(uint8_t mux, const char* host, uint16_t port,
+                      const uint8_t* buff, size_t len) {
+    GsmUdp* udp = udpSockets[mux];
+    if (udp->peer_port != port || udp->peer_host != host) {
+      if (udp->peer_port) { modemUdpStop(mux); }
+      sendAT(GF("+CIPSTART="), mux, GF(",\"UDP\",\""), host, GF("\",\""),
+             port, GF("\""));
+      if (!waitConnectResult(mux, 75000L)) { return 0; }
+      udp->peer_host = host;
+      udp->peer_port = port;
+    }
+    return modemSend(buff, len, mux);
+  }
+
+  void modemUdpRead(uint8_t mux) {
+    GsmUdp* udp = udpSockets[mux];
+    if (!udp->peer_port) { return; }
+    // The modem has no notion of datagrams here, whatever is waiting when
+    // asked is taken as one
+    sendAT(GF("+CIPRXGET=4,"), mux);
+    if (waitResponse(GF("+CIPRXGET:")) != 1) { return; }
+    streamSkipUntil(',');  // Skip mode 4
+    streamSkipUntil(',');  // Skip mux
+    int16_t len = streamGetIntBefore('\n');
+    waitResponse();
+    if (len <= 0) { return; }
+#ifdef SIMPLE_NB_USE_HEX
+    sendAT(GF("+CIPRXGET=3,"), mux, ',', (uint16_t)len);
+#else
+    sendAT(GF("+CIPRXGET=2,"), mux, ',', (uint16_t)len);
+#endif
+    if (waitResponse(GF("+CIPRXGET:")) != 1) { return; }
+    streamSkipUntil(',');  // Skip Rx mode 2/normal or 3/HEX
+    streamSkipUntil(',');  // Skip mux
+    int16_t len_requested = streamGetIntBefore(',');
+    streamSkipUntil('\n');  // Skip the number of bytes left
+    IPAddress ip;
+    ip.fromString(udp->peer_host.c_str());
+#ifdef SIMPLE_NB_USE_HEX
+    moveDatagramFromStreamToFifo(mux, len_requested, ip, udp->peer_port, true);
+#else
+    moveDatagramFromStreamToFifo(mux, len_requested, ip, udp->peer_port);
+#endif
+    waitResponse();
+  }
+
+  void modemUdpStop(uint8_t mux) {
+    sendAT(GF("+CIPCLOSE="), mux);
+    waitResponse(3000);
+    udpSockets[mux]->peer_port = 0;
+  }
+
   /*
    * Utilities
    */
@@ -597,6 +712,8 @@ protected:
         } else if (r5 && data.endsWith(r5)) {
           index = 5;
           goto finish;
+        } else if (handleRegistrationUrc(data)) {
+          data = "";
         } else if (data.endsWith(GF(ACK_NL "+CIPRXGET:"))) {
           int8_t mode = streamGetIntBefore(',');
           if (mode == 1) {
@@ -604,6 +721,9 @@ protected:
             if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && sockets[mux]) {
               sockets[mux]->got_data = true;
             }
+            if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && udpSockets[mux]) {
+              udpSockets[mux]->got_data = true;
+            }
             data = "";
             DBG("### Got Data on socket:", mux);
           } else {
@@ -618,6 +738,14 @@ protected:
           }
           data = "";
           DBG("### READ: " + String(len) + " from " + String(mux));
+        } else if (data.endsWith(GF("CONNECT OK" ACK_NL)) ||
+                   data.endsWith(GF("CONNECT FAIL" ACK_NL))) {
+          // Outcome of an asynchronous open, <n>, CONNECT OK
+          bool   ok  = data.endsWith(GF("CONNECT OK" ACK_NL));
+          int8_t mux = muxBefore(data, ok ? 12 : 14);
+          asyncOpenDone(mux, ok);
+          data = "";
+          DBG("### URC OPEN:", mux, ok);
         } else if (data.endsWith(GF("CLOSED" ACK_NL))) {
           int8_t nl   = data.lastIndexOf(ACK_NL, data.length() - 8);
           int8_t coma = data.indexOf(',', nl + 2);
@@ -625,26 +753,32 @@ protected:
           if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && sockets[mux]) {
             sockets[mux]->sock_connected = false;
           }
+          if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && udpSockets[mux]) {
+            udpSockets[mux]->peer_port = 0;
+          }
           data = "";
           DBG("### Closed socket: ", mux);
         } else if (data.endsWith(GF("*PSNWID:"))) {
-          streamSkipUntil('\n');  // Refresh network name by network
+          parseNetworkName();  // Refresh network name by network
           data = "";
           DBG("### Network name updated.");
         } else if (data.endsWith(GF("*PSUTTZ:"))) {
-          streamSkipUntil('\n');  // Refresh time and time zone by network
+          parseNetworkTime();  // Refresh time and time zone by network
           data = "";
           DBG("### Network time and time zone updated.");
         } else if (data.endsWith(GF("+CTZV:"))) {
-          streamSkipUntil('\n');  // Refresh network time zone by network
+          parseTimeZone();  // Refresh network time zone by network
           data = "";
           DBG("### Network time zone updated.");
         } else if (data.endsWith(GF("DST: "))) {
-          streamSkipUntil(
-              '\n');  // Refresh Network Daylight Saving Time by network
+          parseDaylightSaving();  // Refresh daylight saving time by network
           data = "";
           DBG("### Daylight savings time state updated.");
+        } else if (data.endsWith(GF("+CPSMSTATUS:"))) {
+          parsePsmStatus();
+          data = "";
         } else if (data.endsWith(GF(ACK_NL "SMS Ready" ACK_NL))) {
+          clearSettingsShadow();  // the modem has restarted
           data = "";
           DBG("### Unexpected module reset!");
           init();
@@ -689,6 +823,7 @@ protected:
 
  protected:
   GsmClientSim7000* sockets[SIMPLE_NB_MUX_COUNT];
+  GsmUdp*           udpSockets[SIMPLE_NB_MUX_COUNT];
   String            certificates[SIMPLE_NB_MUX_COUNT];
   String            _apn = "stmiot";  //TO-DO: remove hardcoded apn
 };
@@ -22,18 +22,28 @@
 #include "SimpleNBSSL.tpp"
 #include "SimpleNBGPS.tpp"
 #include "SimpleNBGSMLocation.tpp"
+#include "SimpleNBBands.tpp"
+#include "SimpleNBPowerSaving.tpp"
+#include "SimpleNBRadioQuality.tpp"
+#include "SimpleNBScheduler.tpp"
 
 class SimpleNBSim7000SSL
     : public SimpleNBSim70xx<SimpleNBSim7000SSL>,
       public SimpleNBTCP<SimpleNBSim7000SSL, SIMPLE_NB_MUX_COUNT>,
       public SimpleNBSSL<SimpleNBSim7000SSL>,
       public SimpleNBGPS<SimpleNBSim7000SSL>,
-      public SimpleNBGSMLocation<SimpleNBSim7000SSL> {
+      public SimpleNBGSMLocation<SimpleNBSim7000SSL>,
+      public SimpleNBBands<SimpleNBSim7000SSL>,
+      public SimpleNBPowerSaving<SimpleNBSim7000SSL>,
+      public SimpleNBRadioQuality<SimpleNBSim7000SSL> {
   friend class SimpleNBSim70xx<SimpleNBSim7000SSL>;
   friend class SimpleNBTCP<SimpleNBSim7000SSL, SIMPLE_NB_MUX_COUNT>;
   friend class SimpleNBSSL<SimpleNBSim7000SSL>;
   friend class SimpleNBGPS<SimpleNBSim7000SSL>;
   friend class SimpleNBGSMLocation<SimpleNBSim7000SSL>;
+  friend class SimpleNBBands<SimpleNBSim7000SSL>;
+  friend class SimpleNBPowerSaving<SimpleNBSim7000SSL>;
+  friend class SimpleNBRadioQuality<SimpleNBSim7000SSL>;
 
   /*
    * Inner Client
@@ -72,10 +82,20 @@ class SimpleNBSim7000SSL
       SIMPLE_NB_YIELD();
       rx.clear();
       sock_connected = at->modemConnect(host, port, mux, false, timeout_s);
+      if (!sock_connected) { at->connectFailed(mux); }
       return sock_connected;
     }
     SIMPLE_NB_CLIENT_CONNECT_OVERRIDES
 
+    int connectAsync(const char* host, uint16_t port) override {
+      stop();
+      SIMPLE_NB_YIELD();
+      rx.clear();
+      sock_connected = false;
+      bool accepted = at->modemConnect(host, port, mux, false, 75, true);
+      return connectStarted(accepted, 75);
+    }
+
     void stop(uint32_t maxWaitMs) {
       dumpModemBuffer(maxWaitMs);
       at->sendAT(GF("+CACLOSE="), mux);
@@ -118,6 +138,15 @@ class SimpleNBSim7000SSL
       return sock_connected;
     }
     SIMPLE_NB_CLIENT_CONNECT_OVERRIDES
+
+    int connectAsync(const char* host, uint16_t port) override {
+      stop();
+      SIMPLE_NB_YIELD();
+      rx.clear();
+      sock_connected = false;
+      bool accepted = at->modemConnect(host, port, mux, true, 75, true);
+      return connectStarted(accepted, 75);
+    }
   };
 
   /*
@@ -144,17 +173,15 @@ class SimpleNBSim7000SSL
     if (waitResponse() != 1) { return false; }
 
 #ifdef SIMPLE_NB_DEBUG
-    sendAT(GF("+CMEE=2"));  // turn on verbose error codes
+    sendATSetting(1000L, GF("+CMEE=2"));  // turn on verbose error codes
 #else
-    sendAT(GF("+CMEE=0"));  // turn off error codes
+    sendATSetting(1000L, GF("+CMEE=0"));  // turn off error codes
 #endif
-    waitResponse();
 
     getModemName();
 
     // Enable Local Time Stamp for getting network time
-    sendAT(GF("+CLTS=1"));
-    if (waitResponse(10000L) != 1) { return false; }
+    if (!sendATSetting(10000L, GF("+CLTS=1"))) { return false; }
 
     // Enable battery checks
     // This command return +CME ERROR: Call index error
@@ -162,6 +189,10 @@ class SimpleNBSim7000SSL
     // sendAT(GF("+CBATCHK=1"));
     // if (waitResponse() != 1) { return false; }
 
+    // Report registration changes, with the serving cell, as they happen
+    enableRegistrationUrc(GF("+CEREG=2"));
+    enableRegistrationUrc(GF("+CGREG=2"));
+
     SimStatus ret = getSimStatus();
     // if the sim isn't ready and a pin has been provided, try to unlock the sim
     if (ret != SIM_READY && pin != NULL && strlen(pin) > 0) {
@@ -174,6 +205,13 @@ class SimpleNBSim7000SSL
     }
   }
 
+  // Warm start, the settings of the full init were saved with AT&W
+  bool fastStartImpl() {
+    if (!testAT()) { return false; }
+    return checkSettings(GF("+CMEE?;+CLTS?;+CPIN?"),
+                         SIMPLE_NB_CMEE_REPLY, "+CLTS: 1", "+CPIN: READY");
+  }
+
   void maintainImpl() {
     // Keep listening for modem URC's and proactively iterate through
     // sockets asking if any data is avaiable
@@ -486,13 +524,14 @@ protected:
    * Client related functions
    */
  protected:
+  // With async set this returns once the open command is accepted, the
+  // +CAOPEN URC then completes the socket in waitResponse()
   bool modemConnect(const char* host, uint16_t port, uint8_t mux,
-                    bool ssl = false, int timeout_s = 75) {
+                    bool ssl = false, int timeout_s = 75, bool async = false) {
     uint32_t timeout_ms = ((uint32_t)timeout_s) * 1000;
 
     // set the connection (mux) identifier to use
-    sendAT(GF("+CACID="), mux);
-    if (waitResponse(timeout_ms) != 1) return false;
+    if (!sendATSetting(timeout_ms, GF("+CACID="), mux)) return false;
 
 
     if (ssl) {
@@ -506,8 +545,11 @@ protected:
       //              4: QAPI_NET_SSL_PROTOCOL_DTLS_1_0
       //              5: QAPI_NET_SSL_PROTOCOL_DTLS_1_2
       // NOTE:  despite docs using caps, "sslversion" must be in lower case
-      sendAT(GF("+CSSLCFG=\"sslversion\",0,3"));  // TLS 1.2
-      if (waitResponse(5000L) != 1) return false;
+      // TLS 1.2
+      if (!sendATIndexedSetting(5000L, 2,
+                                GF("+CSSLCFG=\"sslversion\",0,3"))) {
+        return false;
+      }
     }
 
     // enable or disable ssl
@@ -515,38 +557,39 @@ protected:
     // <cid> Application connection ID (set with AT+CACID above)
     // <sslFlag> 0: Not support SSL
     //           1: Support SSL
-    sendAT(GF("+CASSLCFG="), mux, ',', GF("ssl,"), ssl);
-    waitResponse();
+    sendATIndexedSetting(1000L, 2, GF("+CASSLCFG="), mux, ',', GF("ssl,"), ssl);
 
     if (ssl) {
       // set the PDP context to apply SSL to
       // AT+CSSLCFG="CTXINDEX",<ctxindex>
       // <ctxindex> PDP context identifier
       // NOTE:  despite docs using caps, "ctxindex" must be in lower case
-      sendAT(GF("+CSSLCFG=\"ctxindex\",0"));
-      if (waitResponse(5000L, GF("+CSSLCFG:")) != 1) return false;
-      streamSkipUntil('\n');  // read out the certificate information
-      waitResponse();
+      // the certificate information it returns is dropped
+      if (!sendATIndexedSetting(5000L, 1, GF("+CSSLCFG=\"ctxindex\",0"))) {
+        return false;
+      }
 
       if (certificates[mux] != "") {
         // apply the correct certificate to the connection
         // AT+CASSLCFG=<cid>,"CACERT",<caname>
         // <cid> Application connection ID (set with AT+CACID above)
         // <certname> certificate name
-        sendAT(GF("+CASSLCFG="), mux, ",CACERT,\"", certificates[mux].c_str(),
-               "\"");
-        if (waitResponse(5000L) != 1) return false;
+        if (!sendATIndexedSetting(5000L, 2, GF("+CASSLCFG="), mux,
+                                  ",CACERT,\"", certificates[mux].c_str(),
+                                  "\"")) {
+          return false;
+        }
       }
 
       // set the protocol
       // 0:  TCP; 1: UDP
-      sendAT(GF("+CASSLCFG="), mux, ',', GF("protocol,0"));
-      waitResponse();
+      sendATIndexedSetting(1000L, 2, GF("+CASSLCFG="), mux, ',',
+                           GF("protocol,0"));
 
       // set the SSL SNI (server name indication)
       // NOTE:  despite docs using caps, "sni" must be in lower case
-      sendAT(GF("+CSSLCFG=\"sni\","), mux, ',', GF("\""), host, GF("\""));
-      waitResponse();
+      sendATIndexedSetting(1000L, 2, GF("+CSSLCFG=\"sni\","), mux, ',',
+                           GF("\""), host, GF("\""));
     }
 
     // actually open the connection
@@ -554,8 +597,10 @@ protected:
     // <cid> TCP/UDP identifier
     // <conn_type> "TCP" or "UDP"
     // NOTE:  the "TCP" can't be included
-    sendAT(GF("+CAOPEN="), mux, GF(",\""), host, GF("\","), port);
-    if (waitResponse(timeout_ms, GF(ACK_NL "+CAOPEN:")) != 1) { return 0; }
+    // Plain TCP goes to the cached address, TLS keeps the name
+    String addr = ssl ? String(host) : connectHost(host, mux, -1);
+    sendAT(GF("+CAOPEN="), mux, GF(",\""), addr, GF("\","), port);
+    if (async) { return waitResponse() == 1; }
     // returns OK/r/n/r/n+CAOPEN: <cid>,<result>
     // <result> 0: Success
     //          1: Socket error
@@ -573,10 +618,8 @@ protected:
     //          25: Certificate’s common name does not match
     //          26: Certificate’s common name does not match and time expired
     //          27: Connect failed
-    streamSkipUntil(',');  // Skip mux
-
-    // make sure the connection really opened
-    int8_t res = streamGetIntBefore('\n');
+    int16_t res = waitOpenResult(mux, timeout_ms, GF(ACK_NL "+CAOPEN:"));
+    if (res < 0) { return 0; }
     waitResponse();
 
     return 0 == res;
@@ -635,7 +678,7 @@ protected:
         SIMPLE_NB_YIELD();
       }
       char c = stream.read();
-      sockets[mux]->rx.put(c);
+      sockets[mux]->put(c);
     }
     waitResponse();
     // DBG("### READ:", len_confirmed, "from", mux);
@@ -797,6 +840,8 @@ protected:
         } else if (r5 && data.endsWith(r5)) {
           index = 5;
           goto finish;
+        } else if (handleRegistrationUrc(data)) {
+          data = "";
         } else if (data.endsWith(GF("+CARECV:"))) {
           int8_t  mux = streamGetIntBefore(',');
           int16_t len = streamGetIntBefore('\n');
@@ -806,6 +851,13 @@ protected:
           }
           data = "";
           DBG("### READ: " + String(len) + " from " + String(mux));
+        } else if (data.endsWith(GF(ACK_NL "+CAOPEN:"))) {
+          // Outcome of an asynchronous open, +CAOPEN: <cid>,<result>
+          int8_t  mux = streamGetIntBefore(',');
+          int16_t res = streamGetIntBefore('\n');
+          asyncOpenDone(mux, 0 == res);
+          data = "";
+          DBG("### URC OPEN:", mux, res);
         } else if (data.endsWith(GF("+CADATAIND:"))) {
           int8_t mux = streamGetIntBefore('\n');
           if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && sockets[mux]) {
@@ -824,23 +876,26 @@ protected:
           }
           data = "";
         } else if (data.endsWith(GF("*PSNWID:"))) {
-          streamSkipUntil('\n');  // Refresh network name by network
+          parseNetworkName();  // Refresh network name by network
           data = "";
           DBG("### Network name updated.");
         } else if (data.endsWith(GF("*PSUTTZ:"))) {
-          streamSkipUntil('\n');  // Refresh time and time zone by network
+          parseNetworkTime();  // Refresh time and time zone by network
           data = "";
           DBG("### Network time and time zone updated.");
         } else if (data.endsWith(GF("+CTZV:"))) {
-          streamSkipUntil('\n');  // Refresh network time zone by network
+          parseTimeZone();  // Refresh network time zone by network
           data = "";
           DBG("### Network time zone updated.");
         } else if (data.endsWith(GF("DST: "))) {
-          streamSkipUntil(
-              '\n');  // Refresh Network Daylight Saving Time by network
+          parseDaylightSaving();  // Refresh daylight saving time by network
           data = "";
           DBG("### Daylight savings time state updated.");
+        } else if (data.endsWith(GF("+CPSMSTATUS:"))) {
+          parsePsmStatus();
+          data = "";
         } else if (data.endsWith(GF(ACK_NL "SMS Ready" ACK_NL))) {
+          clearSettingsShadow();  // the modem has restarted
           data = "";
           DBG("### Unexpected module reset!");
           init();
@@ -9,18 +9,64 @@
 #ifndef SRC_SIMPLE_NB_CLIENTSIM7020_H_
 #define SRC_SIMPLE_NB_CLIENTSIM7020_H_
 
+// #define SIMPLE_NB_USE_HTTP
+
 #define SIMPLE_NB_MUX_COUNT 6
-#define SIMPLE_NB_BUFFER_READ_AND_CHECK_SIZE
+#define SIMPLE_NB_NO_MODEM_BUFFER
+
+// Maximum payload bytes per AT+CSOSEND, the hex string is twice as long
+#if !defined(SIMPLE_NB_SIM7020_SEND_CHUNK)
+#define SIMPLE_NB_SIM7020_SEND_CHUNK 512
+#endif
+
+// Characters of a certificate per AT+CTLSCFG, longer ones go in several
+#if !defined(SIMPLE_NB_SIM7020_CERT_CHUNK)
+#define SIMPLE_NB_SIM7020_CERT_CHUNK 256
+#endif
+
+// The modem pushes received data in +CSONMI URCs of up to 512 bytes, the
+// socket FIFO takes a whole one (it keeps one slot free)
+#if !defined(SIMPLE_NB_RX_BUFFER)
+#define SIMPLE_NB_RX_BUFFER (512 + 1)
+#endif
+
+// Bytes of an HTTP response body kept until httpRead(), the modem pushes the
+// body in URCs and what doesn't fit is dropped
+#if !defined(SIMPLE_NB_SIM7020_HTTP_BUFFER)
+#define SIMPLE_NB_SIM7020_HTTP_BUFFER 512
+#endif
 
 #include "SimpleNBClientSIM70xx.h"
 #include "SimpleNBTCP.tpp"
+#include "SimpleNBSSL.tpp"
+#include "SimpleNBBands.tpp"
+#include "SimpleNBPowerSaving.tpp"
+#include "SimpleNBRadioQuality.tpp"
+#include "SimpleNBScheduler.tpp"
+#ifdef SIMPLE_NB_USE_HTTP
+#include "SimpleNBHttp.tpp"
+#endif
 
 
 class SimpleNBSim7020
   : public SimpleNBSim70xx<SimpleNBSim7020>,
-    public SimpleNBTCP<SimpleNBSim7020, SIMPLE_NB_MUX_COUNT> {
+    public SimpleNBTCP<SimpleNBSim7020, SIMPLE_NB_MUX_COUNT>,
+    public SimpleNBSSL<SimpleNBSim7020>,
+    public SimpleNBBands<SimpleNBSim7020>,
+    public SimpleNBPowerSaving<SimpleNBSim7020>,
+#ifdef SIMPLE_NB_USE_HTTP
+    public SimpleNBHttp<SimpleNBSim7020>,
+#endif
+    public SimpleNBRadioQuality<SimpleNBSim7020> {
   friend class SimpleNBSim70xx<SimpleNBSim7020>;
   friend class SimpleNBTCP<SimpleNBSim7020, SIMPLE_NB_MUX_COUNT>;
+  friend class SimpleNBSSL<SimpleNBSim7020>;
+  friend class SimpleNBBands<SimpleNBSim7020>;
+  friend class SimpleNBPowerSaving<SimpleNBSim7020>;
+  friend class SimpleNBRadioQuality<SimpleNBSim7020>;
+#ifdef SIMPLE_NB_USE_HTTP
+  friend class SimpleNBHttp<SimpleNBSim7020>;
+#endif
 
   /*
    * Inner Client
@@ -55,19 +101,34 @@ class SimpleNBSim7020
 
    public:
     virtual int connect(const char* host, uint16_t port, int timeout_s) {
-      stop();
+      if (sock_connected) stop();
       SIMPLE_NB_YIELD();
       rx.clear();
-      sock_connected = at->modemConnect(host, port, mux, false, timeout_s);
+
+      // The socket id is assigned by the modem on +CSOC, so the mux may change
+      uint8_t oldMux = mux;
+      sock_connected = at->modemConnect(host, port, &mux, false, timeout_s);
+      if (mux != oldMux) {
+        DBG("WARNING:  Mux number changed from", oldMux, "to", mux);
+        // A client that isn't connected may hold the id the modem gave, it
+        // moves to the slot this one leaves
+        GsmClientSim7020* other = at->sockets[mux];
+        if (at->sockets[oldMux] == this) {
+          at->sockets[oldMux] = other;
+          if (other) { other->mux = oldMux; }
+        }
+      }
+      at->sockets[mux] = this;
       return sock_connected;
     }
     SIMPLE_NB_CLIENT_CONNECT_OVERRIDES
 
     void stop(uint32_t maxWaitMs) {
       dumpModemBuffer(maxWaitMs);
-      at->sendAT(GF("+CIPCLOSE="), mux);
+      at->sendAT(GF("+CSOCL="), mux);
       sock_connected = false;
-      at->waitResponse(GF("CLOSE OK"));
+      at->sock_failed &= ~(1 << mux);
+      at->waitResponse();
     }
     void stop() override {
       stop(15000L);
@@ -83,15 +144,82 @@ class SimpleNBSim7020
   /*
    * Inner Secure Client
    */
-  // NOTE:  Use modem SimpleNBSim7020SSL for a secure client!
+  // TLS connections run on the modem's own TLS engine (AT+CTLS*), which has
+  // its own connection ids (<tid> 1-6), so secure clients are tracked apart
+  // from the plain +CSOC sockets.
+  class GsmClientSecureSim7020 : public GsmClientSim7020 {
+    friend class SimpleNBSim7020;
+
+   public:
+    GsmClientSecureSim7020() {}
+
+    explicit GsmClientSecureSim7020(SimpleNBSim7020& modem, uint8_t mux = 0) {
+      init(&modem, mux);
+    }
+
+    bool init(SimpleNBSim7020* modem, uint8_t mux = 0) {
+      this->at       = modem;
+      sock_available = 0;
+      prev_check     = 0;
+      sock_connected = false;
+      got_data       = false;
+      this->mux      = mux % SIMPLE_NB_MUX_COUNT;
+      at->secureSockets[this->mux] = this;
+      return true;
+    }
+
+   public:
+    bool setCertificate(const String& certificate) {
+      return at->setCertificate(certificate, mux);
+    }
+
+    int connect(const char* host, uint16_t port, int timeout_s) override {
+      if (sock_connected) stop();
+      SIMPLE_NB_YIELD();
+      rx.clear();
+      sock_connected = at->modemConnectTLS(host, port, mux, timeout_s);
+      return sock_connected;
+    }
+    SIMPLE_NB_CLIENT_CONNECT_OVERRIDES
+
+    size_t write(const uint8_t* buf, size_t size) override {
+      SIMPLE_NB_YIELD();
+      at->maintain();
+      at->startUplink(rai);
+      size_t sent = at->modemSendHex(GF("AT+CTLSSEND="), mux + 1, buf, size);
+      at->endUplink();
+      return sent;
+    }
+    size_t write(uint8_t c) override {
+      return write(&c, 1);
+    }
+
+    uint8_t connected() override {
+      if (available()) { return true; }
+      // The state is kept up to date by the +CTLSCLOSE URC
+      return sock_connected;
+    }
+
+    void stop(uint32_t maxWaitMs) {
+      dumpModemBuffer(maxWaitMs);
+      at->sendAT(GF("+CTLSCLOSE="), mux + 1);
+      sock_connected = false;
+      at->waitResponse();
+    }
+    void stop() override {
+      stop(15000L);
+    }
+  };
 
   /*
    * Constructor
    */
  public:
   explicit SimpleNBSim7020(Stream& stream)
-      : SimpleNBSim70xx<SimpleNBSim7020>(stream) {
+      : SimpleNBSim70xx<SimpleNBSim7020>(stream),
+        certificates() {
     memset(sockets, 0, sizeof(sockets));
+    memset(secureSockets, 0, sizeof(secureSockets));
   }
 
   /*
@@ -108,21 +236,21 @@ class SimpleNBSim7020
     if (waitResponse() != 1) { return false; }
 
 #ifdef SIMPLE_NB_DEBUG
-    sendAT(GF("+CMEE=2"));  // turn on verbose error codes
+    sendATSetting(1000L, GF("+CMEE=2"));  // turn on verbose error codes
 #else
-    sendAT(GF("+CMEE=0"));  // turn off error codes
+    sendATSetting(1000L, GF("+CMEE=0"));  // turn off error codes
 #endif
-    waitResponse();
 
     getModemName();
 
     // Enable Local Time Stamp for getting network time
-    sendAT(GF("+CLTS=1"));
-    if (waitResponse(10000L) != 1) { return false; }
+    if (!sendATSetting(10000L, GF("+CLTS=1"))) { return false; }
 
     // Enable battery checks
-    sendAT(GF("+CBATCHK=1"));
-    if (waitResponse() != 1) { return false; }
+    if (!sendATSetting(1000L, GF("+CBATCHK=1"))) { return false; }
+
+    // Report registration changes, with the serving cell, as they happen
+    enableRegistrationUrc(GF("+CEREG=2"));
 
     SimStatus ret = getSimStatus();
     // if the sim isn't ready and a pin has been provided, try to unlock the sim
@@ -136,6 +264,14 @@ class SimpleNBSim7020
     }
   }
 
+  // Warm start, the settings of the full init were saved with AT&W
+  bool fastStartImpl() {
+    if (!testAT()) { return false; }
+    return checkSettings(GF("+CMEE?;+CLTS?;+CBATCHK?;+CPIN?"),
+                         SIMPLE_NB_CMEE_REPLY, "+CLTS: 1", "+CBATCHK: 1",
+                         "+CPIN: READY");
+  }
+
   String getModemNameImpl() {
     String name = "SIMCom SIM70XX";
 
@@ -181,27 +317,19 @@ class SimpleNBSim7020
    */
  public:
    bool activateDataNetwork() {
-     // SIM7020 supports multiple TCP/IP client up to 6 sockets. To create a TCP/UDP Socket
-     // AT+CSOC=<domain>,<type>,<protocol>[,<cid>]
-     // +CSOC: <cid> is returned as the socket ID
-     // that has been created.
-     // <domain>: 1=IPv4, 2=IPv6
-     // <type>: 1=TCP, 2=UDP, 3=RAW
-     // <protocol>: 1=IP, 2=ICMP
-     // <cid>: Optional. Although the documenation say can passing-in a <cid>, but actual
-     // implementation dos not allowed (you get an ERROR).
-     sendAT(GF("+CSOC=1,1,1"));
-     if (waitResponse(60000L) != 1) { return false; }
-     int16_t cid = streamGetIntBefore('\n');
-     waitResponse();
-     if (cid < SIMPLE_NB_MUX_COUNT)
-       return true;
-     return false;
+     // The default EPS bearer (cid 1) is normally activated on attach, this
+     // only makes sure it is up. Sockets are created per connection with
+     // AT+CSOC in modemConnect().
+     sendAT(GF("+CGACT=1,1"));
+     return waitResponse(60000L) == 1;
    }
 
    bool deactivateDataNetwork() {
-     sendAT(GF("+CSOC=0"));
-     if (waitResponse(60000L) != 1) { return false; }
+     // Release every socket the modem may still hold
+     for (int mux = 0; mux < SIMPLE_NB_MUX_COUNT; mux++) {
+       GsmClientSim7020* sock = sockets[mux];
+       if (sock && sock->sock_connected) { sock->stop(); }
+     }
      return true;
    }
 
@@ -215,6 +343,165 @@ class SimpleNBSim7020
     res.trim();
     return res;
   }
+  /*
+   * Band functions
+   */
+ protected:
+  // NB-IoT only, AT+CBAND=<band>[,<band>...]
+  bool setBandMaskImpl(RadioTech rat, const uint64_t mask[2]) {
+    if (rat != RADIO_NBIOT || (!mask[0] && !mask[1])) { return false; }
+    sendAT(GF("+CBAND="), maskToList(mask));
+    return waitResponse() == 1;
+  }
+
+  bool getBandMaskImpl(RadioTech rat, uint64_t mask[2]) {
+    if (rat != RADIO_NBIOT) { return false; }
+    sendAT(GF("+CBAND?"));
+    if (waitResponse(GF("+CBAND:")) != 1) { return false; }
+    listToMask(stream.readStringUntil('\n'), mask);
+    waitResponse();
+    return true;
+  }
+
+  // There is only NB-IoT to search
+  bool setScanSequenceImpl(RadioTech first, RadioTech second,
+                           RadioTech third) {
+    return hasRadio(RADIO_NBIOT, first, second, third) &&
+           !hasRadio(RADIO_CATM, first, second, third) &&
+           !hasRadio(RADIO_GSM, first, second, third);
+  }
+
+  bool getServingCellImpl(AttachInfo_t& info) {
+    // +CENG: <earfcn>,<earfcn_offset>,<pci>,<cellid>,<rsrp>,...
+    sendAT(GF("+CENG?"));
+    if (waitResponse(GF("+CENG:")) != 1) { return false; }
+    uint32_t earfcn = streamGetIntBefore(',');
+    streamSkipUntil('\n');
+    waitResponse();
+    info.rat    = RADIO_NBIOT;
+    info.earfcn = earfcn;
+    info.band   = bandFromEarfcn(earfcn);
+    return info.band != 0;
+  }
+
+  /*
+   * Radio quality functions
+   */
+ protected:
+  bool sampleRadioQualityImpl(RadioQuality_t& sample) {
+    // +CENG: <earfcn>,<earfcn_offset>,<pci>,"<cellid>",<rsrp>,<rsrq>,<rssi>,
+    // <snr>,<band>,"<tac>",<ecl>,<tx_pwr>,... with RSRP, RSRQ and SNR in
+    // tenths of dBm and dB
+    sendAT(GF("+CENG?"));
+    if (waitResponse(GF("+CENG:")) != 1) { return false; }
+    String line = stream.readStringUntil('\n');
+    waitResponse();
+    if (csvField(line, 4).length() == 0) { return false; }
+    sample.rat      = RADIO_NBIOT;
+    sample.earfcn   = line.toInt();
+    sample.cell     = strtoul(csvField(line, 3).c_str(), NULL, 16);
+    sample.rsrp     = csvField(line, 4).toFloat() / 10;
+    sample.rsrq     = csvField(line, 5).toFloat() / 10;
+    sample.sinr     = csvField(line, 7).toFloat() / 10;
+    sample.band     = csvField(line, 8).toInt();
+    sample.ce_level = csvField(line, 10).toInt();
+    return sample.rsrp != 0;
+  }
+
+  /*
+   * Secure socket layer functions
+   */
+ protected:
+  // The SIM7020 takes the PEM content of the CA certificate rather than the
+  // name of a file stored on the modem
+  bool setCertificate(const String& certificate, const uint8_t mux = 0) {
+    if (mux >= SIMPLE_NB_MUX_COUNT) return false;
+    certificates[mux] = certificate;
+    return true;
+  }
+
+#ifdef SIMPLE_NB_USE_HTTP
+  /*
+   * HTTP functions
+   */
+ protected:
+  // An https server is never checked, so only httpSetInsecure() gets there
+  bool httpConnectImpl() {
+    if (http_ssl && http_ca.length()) {
+      DBG("### The SIM7020 can't check an HTTPS server, use a secure client");
+      return false;
+    }
+    sendAT(GF("+CHTTPCREATE=\""), http_ssl ? GF("https://") : GF("http://"),
+           http_host, ':', http_port, GF("/\""));
+    if (waitResponse(GF("+CHTTPCREATE:")) != 1) { return false; }
+    http_client = streamGetIntBefore('\n');
+    waitResponse();
+    if (http_client < 0) { return false; }
+    sendAT(GF("+CHTTPCON="), http_client);
+    if (waitResponse(SIMPLE_NB_HTTP_TIMEOUT) != 1) {
+      httpCloseImpl();
+      return false;
+    }
+    return true;
+  }
+
+  // AT+CHTTPSEND=<id>,<method>,"<path>",<headers>,"<content_type>",<body>
+  // with the headers and the body as hex strings. The response comes in
+  // +CHTTPNMIH and +CHTTPNMIC URCs.
+  int httpSendImpl(HttpMethod method, const String& path, const uint8_t* body,
+                   size_t len, const char* content_type) {
+    String headers = httpHeaderLines();
+    http_rx.clear();
+    http_code     = -1;
+    http_done     = false;
+    http_overflow = false;
+    streamWrite(GF("AT+CHTTPSEND="), http_client, ',', (int)method, GF(",\""),
+                path, '"');
+    if (headers.length() || len) {
+      stream.write(',');
+      SimpleNBWriteHex(stream, headers.c_str(), headers.length());
+    }
+    if (len) {
+      streamWrite(GF(",\""), content_type ? content_type : "", GF("\","));
+      SimpleNBWriteHex(stream, body, len);
+    }
+    streamWrite(gsmNL);
+    stream.flush();
+    if (waitResponse(SIMPLE_NB_HTTP_TIMEOUT) != 1) { return -1; }
+    uint32_t startMillis = millis();
+    while (http_code < 0 && !http_done &&
+           millis() - startMillis < SIMPLE_NB_HTTP_TIMEOUT) {
+      waitResponse(100);
+    }
+    return http_code;
+  }
+
+  // A body that outgrew SIMPLE_NB_SIM7020_HTTP_BUFFER before it was read
+  // lost its overflow, that is reported rather than handing out a gap
+  int httpReadImpl(uint8_t* buf, size_t size) {
+    if (http_overflow) { return -1; }
+    // Without a Content-Length the body ends with the last package or when
+    // nothing more came for a while
+    uint32_t startMillis = millis();
+    while (!http_rx.size() && !http_done && millis() - startMillis < 5000L) {
+      waitResponse(100);
+    }
+    if (http_overflow) { return -1; }
+    int n = http_rx.get(buf, size);
+    updateRts(rxFree());
+    return n;
+  }
+
+  void httpCloseImpl() {
+    if (http_client < 0) { return; }
+    sendAT(GF("+CHTTPDISCON="), http_client);
+    waitResponse();
+    sendAT(GF("+CHTTPDESTROY="), http_client);
+    waitResponse();
+    http_client = -1;
+  }
+#endif
+
   /*
    * GPRS functions
    */
@@ -283,111 +570,172 @@ class SimpleNBSim7020
    * Client related functions
    */
  protected:
-  bool modemConnect(const char* host, uint16_t port, uint8_t mux,
+  bool modemConnect(const char* host, uint16_t port, uint8_t* mux,
                     bool ssl = false, int timeout_s = 75) {
-    if (!sockets[mux]) return 0;
-    if (ssl) { DBG("SSL only supported using application on Sim7020!"); }
+    if (ssl) { DBG("Use GsmClientSecureSim7020 for a secure connection!"); }
     uint32_t timeout_ms = ((uint32_t)timeout_s) * 1000;
 
-    /* Select Data Transmitting Mode */
-    sendAT(GF("+CIPQSEND=1"));
-    if (waitResponse() != 1) { return false; }
-    /* Set to get data manually */
-    sendAT(GF("+CIPRXGET=1"));
+    // Sockets the network dropped still hold one of the modem's ids
+    closeFailedSockets();
+
+    // AT+CSOCON only takes an IP address, resolve host names first
+    String ip = resolve(host);
+    if (!ip.length()) { return false; }
+
+    // Create a TCP socket
+    // AT+CSOC=<domain>,<type>,<protocol>
+    // <domain>: 1=IPv4, 2=IPv6
+    // <type>: 1=TCP, 2=UDP, 3=RAW
+    // <protocol>: 1=IP, 2=ICMP
+    // +CSOC: <socket_id> is returned as the socket ID that has been created,
+    // up to SIMPLE_NB_MUX_COUNT sockets can be opened in parallel
+    sendAT(GF("+CSOC=1,1,1"));
+    if (waitResponse(GF(ACK_NL "+CSOC:")) != 1) { return false; }
+    int16_t id = streamGetIntBefore('\n');
     waitResponse();
-
-    // when not using SSL, the TCP application toolkit is more stable
-    sendAT(GF("+CIPSTART="), GF("\"TCP"), GF("\",\""), host, GF("\","), port);
-    int8_t rsp = 0;
-    rsp = waitResponse(timeout_ms, GF("CONNECT OK" ACK_NL),
-                         GF("CONNECT FAIL" ACK_NL),
-                         GF("ALREADY CONNECT" ACK_NL), GF("ERROR" ACK_NL),
-                         GF("CLOSE OK" ACK_NL));
-    return (rsp == 1);
+    if (id < 0 || id >= SIMPLE_NB_MUX_COUNT) { return false; }
+    *mux = id;
+
+    // Connect the socket
+    // AT+CSOCON=<socket_id>,<remote_port>,<remote_address>
+    sendAT(GF("+CSOCON="), *mux, ',', port, GF(",\""), ip, '"');
+    if (waitResponse(timeout_ms) != 1) {
+      sendAT(GF("+CSOCL="), *mux);
+      waitResponse();
+      dropDnsEntry(host);  // looked up again on the next connect
+      return false;
+    }
+    return true;
   }
 
-  int16_t modemSend(const void* buff, size_t len, uint8_t mux) {
-    if (!sockets[mux]) return 0;
-    sendAT(GF("+CIPSEND="), (uint16_t)len);
-    if (waitResponse(GF(">")) != 1) { return 0; }
+  bool modemConnectTLS(const char* host, uint16_t port, uint8_t mux,
+                       int timeout_s = 75) {
+    uint32_t timeout_ms = ((uint32_t)timeout_s) * 1000;
+    uint8_t  tid        = mux + 1;
+
+    // Configure the TLS connection
+    // AT+CTLSCFG=<tid>,<type>,<value>[,<type>,<value>...]
+    // <tid> TLS connection id, 1-6
+    // <type> 1: Host name, resolved by the modem
+    //        2: Port
+    //        3: Socket type, 0=TCP
+    //        4: Authentication mode, 0=none, 1=verify server
+    //        7: CA certificate (PEM content)
+    bool verify = certificates[mux] != "";
+    sendAT(GF("+CTLSCFG="), tid, GF(",1,\""), host, GF("\",2,"), port,
+           GF(",3,0,4,"), verify ? 1 : 0);
+    if (waitResponse(5000L) != 1) { return false; }
+    if (verify && !sendTlsCertificate(tid, 7, certificates[mux])) {
+      return false;
+    }
 
-    stream.write(reinterpret_cast<const uint8_t*>(buff), len);
-    stream.flush();
+    // Open the connection, the handshake is done entirely on the modem
+    // AT+CTLSCONN=<tid>,<mode>
+    // returns +CTLSCONN: <tid>,<result>, <result> 1: Success
+    sendAT(GF("+CTLSCONN="), tid, GF(",1"));
+    if (waitResponse(timeout_ms, GF(ACK_NL "+CTLSCONN:")) != 1) { return false; }
+    streamSkipUntil(',');  // Skip tid
+    int8_t res = streamGetIntBefore('\n');
+    waitResponse();
+    return 1 == res;
+  }
 
-    if (waitResponse(GF(ACK_NL "DATA ACCEPT:")) != 1) { return 0; }
-    return streamGetIntBefore('\n');
+  // A raw CR or LF would end the command, so the PEM goes with its line
+  // ends escaped as \n, and in consecutive AT+CTLSCFG of the same type,
+  // which the modem joins, where it is longer than the command line takes
+  bool sendTlsCertificate(uint8_t tid, uint8_t type, const String& pem) {
+    size_t from = 0;
+    while (from < pem.length()) {
+      streamWrite(GF("AT+CTLSCFG="), tid, ',', type, GF(",\""));
+      for (size_t n = 0; from < pem.length() &&
+                         n < SIMPLE_NB_SIM7020_CERT_CHUNK; from++) {
+        char c = pem[from];
+        if (c == '\r') { continue; }
+        if (c == '\n') {
+          stream.print(GF("\\n"));
+          n += 2;
+        } else {
+          stream.write(c);
+          n++;
+        }
+      }
+      streamWrite('"', gsmNL);
+      stream.flush();
+      if (waitResponse(5000L) != 1) { return false; }
+    }
+    return true;
   }
 
-  size_t modemRead(size_t size, uint8_t mux) {
+  int16_t modemSend(const void* buff, size_t len, uint8_t mux) {
     if (!sockets[mux]) return 0;
+    return modemSendHex(GF("AT+CSOSEND="), mux, buff, len);
+  }
 
-#ifdef SIMPLE_NB_USE_HEX
-    sendAT(GF("+CIPRXGET=3,"), (uint16_t)size);
-    if (waitResponse(GF("+CIPRXGET:")) != 1) { return 0; }
-#else
-    sendAT(GF("+CIPRXGET=2,"), (uint16_t)size);
-    if (waitResponse(GF("+CIPRXGET:")) != 1) { return 0; }
-#endif
-    streamSkipUntil(',');  // Skip Rx mode 2/normal or 3/HEX
-    int16_t len_requested = streamGetIntBefore(',');
-    //  ^^ Requested number of data bytes (1-1460 bytes)to be read
-    int16_t len_confirmed = streamGetIntBefore('\n');
-    // ^^ Confirmed number of data bytes to be read, which may be less than
-    // requested. 0 indicates that no data can be read.
-    // SRGD NOTE:  Contrary to above (which is copied from AT command manual)
-    // this is actually be the number of bytes that will be remaining in the
-    // buffer after the read.
-    for (int i = 0; i < len_requested; i++) {
-      uint32_t startMillis = millis();
-#ifdef SIMPLE_NB_USE_HEX
-      while (stream.available() < 2 && (millis() - startMillis < sockets[mux]->_timeout)) {
-        SIMPLE_NB_YIELD();
-      }
-      char buf[4] = {0,};
-      buf[0] = stream.read();
-      buf[1] = stream.read();
-      char c = strtol(buf, NULL, 16);
-#else
-      while (!stream.available() && (millis() - startMillis < sockets[mux]->_timeout)) {
-        SIMPLE_NB_YIELD();
-      }
-      char c = stream.read();
-#endif
-      sockets[mux]->rx.put(c);
+  // Sends <cmd><id>,<data_len>,"<data>" with the payload as a hex string,
+  // <data_len> being the length of that string. This is the format used by
+  // both AT+CSOSEND and AT+CTLSSEND.
+  int16_t modemSendHex(GsmConstStr cmd, uint8_t id, const void* buff,
+                       size_t len) {
+    const uint8_t* p    = reinterpret_cast<const uint8_t*>(buff);
+    size_t         sent = 0;
+    while (sent < len) {
+      size_t chunk = SimpleNBMin(len - sent, (size_t)SIMPLE_NB_SIM7020_SEND_CHUNK);
+      streamWrite(cmd, id, ',', (uint16_t)(chunk * 2), GF(",\""));
+      SimpleNBWriteHex(stream, p + sent, chunk);
+      streamWrite('"', gsmNL);
+      stream.flush();
+      if (waitResponse(10000L) != 1) { break; }
+      sent += chunk;
     }
-    // DBG("### READ:", len_requested, "from", mux);
-    // sockets[mux]->sock_available = modemGetAvailable(mux);
-    sockets[mux]->sock_available = len_confirmed;
-    waitResponse();
-    return len_requested;
+    releaseAfterSend();
+    return sent;
   }
 
-  size_t modemGetAvailable(uint8_t mux) {
-    if (!sockets[mux]) return 0;
+  // The send commands take no release assistance, so after the last packet
+  // the standard AT+CNMPSD (no more PS data) asks for the release
+  void releaseAfterSend() {
+    if (uplink_rai != RAI_LAST_PACKET) { return; }
+    sendAT(GF("+CNMPSD"));
+    waitResponse();
+  }
 
-    sendAT(GF("+CIPRXGET=4"), mux);
-    size_t result = 0;
-    if (waitResponse(GF("+CIPRXGET:")) == 1) {
-      streamSkipUntil(',');  // Skip mode 4
-      result = streamGetIntBefore('\n');
+  // Frees the ids of sockets +CSOERR reported, which can't be done from
+  // the URC handler itself
+  void closeFailedSockets() {
+    for (uint8_t mux = 0; mux < SIMPLE_NB_MUX_COUNT; mux++) {
+      if (!(sock_failed & (1 << mux))) { continue; }
+      sendAT(GF("+CSOCL="), mux);
       waitResponse();
     }
-    // DBG("### Available:", result, "on", mux);
-    if (!result) { sockets[mux]->sock_connected = modemGetConnected(mux); }
-    return result;
+    sock_failed = 0;
   }
 
   bool modemGetConnected(uint8_t mux) {
-    if (!sockets[mux]) { return 0;}
-    /* Get Socket Status */
-    sendAT(GF("+CIPSTATUS"));
-    if (waitResponse(GF("STATE: "))) {
-        if (waitResponse(GF("CONNECT OK"), GF("TCP CLOSED"), GF("TCP CONNECTING"), GF("IP INITIAL")) != 1) {
-            return false;
-        }
-    }
-    return true;
+    if (!sockets[mux]) { return false; }
+    // The socket state is kept up to date by the +CSOERR URC
+    return sockets[mux]->sock_connected;
+  }
+
+  // Move the hex payload of a +CSONMI or +CTLSRECV URC into the socket FIFO
+  void modemReadHexToFifo(GsmClientSim7020* sock, int16_t hexLen) {
+    if (hexLen < 0) { hexLen = 0; }  // a garbled URC
+    size_t dropped = SimpleNBReadHexToFifo(stream, sock ? &sock->rx : NULL,
+                                           hexLen, 1000L);
+    if (sock && dropped) { DBG("### Rx FIFO overflow on", sock->mux, dropped); }
+    // The modem pushes data unasked, hold it back while the FIFO is full
+    if (sock) { updateRts(rxFree()); }
+    streamSkipUntil('\n');
+  }
+
+#ifdef SIMPLE_NB_USE_HTTP
+  // The HTTP body is pushed the same way as socket data, RTS minds its
+  // buffer too
+  int rxFree() {
+    typedef SimpleNBTCP<SimpleNBSim7020, SIMPLE_NB_MUX_COUNT> TCP;
+    return SimpleNBMin(TCP::rxFree(), http_rx.free());
   }
+#endif
+
 
   /*
    * Utilities
@@ -437,57 +785,125 @@ class SimpleNBSim7020
         } else if (r5 && data.endsWith(r5)) {
           index = 5;
           goto finish;
-        } else if (data.endsWith(GF(ACK_NL "+CIPRXGET:"))) {
-          int8_t mode = streamGetIntBefore(',');
-          if (mode == 1) {
-            int8_t mux = streamGetIntBefore('\n');
-            if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && sockets[mux]) {
-              sockets[mux]->got_data = true;
-            }
-            data = "";
-            DBG("### Got Data on socket:", mux);
-          } else {
-            data += mode;
-          }
-        } else if (data.endsWith(GF(ACK_NL "+RECEIVE:"))) {
+        } else if (handleRegistrationUrc(data)) {
+          data = "";
+        } else if (data.endsWith(GF("+CSONMI:"))) {
+          // +CSONMI: <socket_id>,<data_len>,<data>
+          // <data_len> is the length of the hex string in <data>
           int8_t  mux = streamGetIntBefore(',');
-          int16_t len = streamGetIntBefore('\n');
-          if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && sockets[mux]) {
-            sockets[mux]->got_data = true;
-            if (len >= 0 && len <= 1024) { sockets[mux]->sock_available = len; }
+          int16_t len = streamGetIntBefore(',');
+          modemReadHexToFifo(
+              (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT) ? sockets[mux] : NULL,
+              len);
+          data = "";
+          DBG("### Got Data:", len / 2, "on", mux);
+        } else if (data.endsWith(GF("+CTLSRECV:"))) {
+          // +CTLSRECV: <tid>,<data_len>,<data>, <data> as a hex string
+          int8_t  tid = streamGetIntBefore(',');
+          int16_t len = streamGetIntBefore(',');
+          modemReadHexToFifo(
+              (tid >= 1 && tid <= SIMPLE_NB_MUX_COUNT) ? secureSockets[tid - 1]
+                                                      : NULL,
+              len);
+          data = "";
+          DBG("### Got TLS Data:", len / 2, "on", tid);
+        } else if (data.endsWith(GF("+CTLSCLOSE:"))) {
+          // +CTLSCLOSE: <tid>,<result>, also sent when the peer closes
+          int8_t tid = streamGetIntBefore(',');
+          streamSkipUntil('\n');
+          if (tid >= 1 && tid <= SIMPLE_NB_MUX_COUNT && secureSockets[tid - 1]) {
+            secureSockets[tid - 1]->sock_connected = false;
           }
           data = "";
-          DBG("### READ: " + String(len) + " from " + String(mux));
-        } else if (data.endsWith(GF("CLOSED" ACK_NL))) {
-          // int8_t nl   = data.lastIndexOf(ACK_NL, data.length() - 8);
-          // int8_t coma = data.indexOf(',', nl + 2);
-          // int8_t mux  = data.substring(nl + 2, coma).toInt();
-          int8_t mux = 0;
-          if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && sockets[mux]) {
-            sockets[mux]->sock_connected = false;
+          DBG("### Closed TLS connection:", tid);
+        } else if (data.endsWith(GF("+CSOERR:"))) {
+          // +CSOERR: <socket_id>,<error_code>, the socket is no longer usable
+          // but keeps its id until closed
+          int8_t mux = streamGetIntBefore(',');
+          streamSkipUntil('\n');
+          if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT) {
+            sock_failed |= 1 << mux;
+            if (sockets[mux]) { sockets[mux]->sock_connected = false; }
           }
           data = "";
-          DBG("### Closed socket: ", mux);
+          DBG("### Closed socket:", mux);
+#ifdef SIMPLE_NB_USE_HTTP
+        } else if (data.endsWith(GF("+CHTTPNMIH:"))) {
+          // +CHTTPNMIH: <id>,<code>,<header_len>,<header>, the raw header
+          // lines of the response
+          streamSkipUntil(',');
+          http_code   = streamGetIntBefore(',');
+          int16_t len = streamGetIntBefore(',');
+          http_response_headers = "";
+          http_response_headers.reserve(len);
+          for (int16_t i = 0; i < len; i++) {
+            uint32_t startMillis = millis();
+            while (!stream.available() && (millis() - startMillis < 1000L)) {
+              SIMPLE_NB_YIELD();
+            }
+            http_response_headers += static_cast<char>(stream.read());
+          }
+          streamSkipUntil('\n');
+          data = "";
+          DBG("### HTTP response:", http_code);
+        } else if (data.endsWith(GF("+CHTTPNMIC:"))) {
+          // +CHTTPNMIC: <id>,<more>,<content_len>,<package_len>,<data>, the
+          // body in packages with <data> as a hex string
+          streamSkipUntil(',');
+          int8_t  more  = streamGetIntBefore(',');
+          int32_t total = stream.readStringUntil(',').toInt();
+          int16_t len   = streamGetIntBefore(',');
+          if (total > 0) { http_length = total; }
+          size_t dropped = SimpleNBReadHexToFifo(
+              stream, &http_rx, SimpleNBMax(len, (int16_t)0) * 2, 1000L);
+          if (dropped) {
+            DBG("### HTTP body overflow:", dropped);
+            http_overflow = true;
+          }
+          updateRts(rxFree());
+          streamSkipUntil('\n');
+          if (!more) { http_done = true; }
+          data = "";
+        } else if (data.endsWith(GF("+CHTTPERR:"))) {
+          // +CHTTPERR: <id>,<error_code>, the connection is lost
+          streamSkipUntil('\n');
+          http_done   = true;
+          http_open   = false;
+          http_client = -1;
+          data = "";
+          DBG("### HTTP connection lost");
+#endif
         } else if (data.endsWith(GF("*PSNWID:"))) {
-          streamSkipUntil('\n');  // Refresh network name by network
+          parseNetworkName();  // Refresh network name by network
           data = "";
           DBG("### Network name updated.");
         } else if (data.endsWith(GF("*PSUTTZ:"))) {
-          streamSkipUntil('\n');  // Refresh time and time zone by network
+          parseNetworkTime();  // Refresh time and time zone by network
           data = "";
           DBG("### Network time and time zone updated.");
         } else if (data.endsWith(GF("+CTZV:"))) {
-          streamSkipUntil('\n');  // Refresh network time zone by network
+          parseTimeZone();  // Refresh network time zone by network
           data = "";
           DBG("### Network time zone updated.");
         } else if (data.endsWith(GF("DST: "))) {
-          streamSkipUntil(
-              '\n');  // Refresh Network Daylight Saving Time by network
+          parseDaylightSaving();  // Refresh daylight saving time by network
           data = "";
           DBG("### Daylight savings time state updated.");
+        } else if (data.endsWith(GF("+CPSMSTATUS:"))) {
+          parsePsmStatus();
+          data = "";
         } else if (data.endsWith(GF(ACK_NL "SMS Ready" ACK_NL))) {
+          clearSettingsShadow();  // the modem has restarted
           data = "";
           DBG("### Unexpected module reset!");
+          // All sockets are lost on a reset
+          sock_failed = 0;
+          for (int mux = 0; mux < SIMPLE_NB_MUX_COUNT; mux++) {
+            if (sockets[mux]) { sockets[mux]->sock_connected = false; }
+            if (secureSockets[mux]) {
+              secureSockets[mux]->sock_connected = false;
+            }
+          }
           init();
         }
       }
@@ -525,8 +941,17 @@ class SimpleNBSim7020
     }
 
  protected:
-  GsmClientSim7020* sockets[SIMPLE_NB_MUX_COUNT];
-  String            certificates[SIMPLE_NB_MUX_COUNT];
+  GsmClientSim7020*       sockets[SIMPLE_NB_MUX_COUNT];
+  GsmClientSecureSim7020* secureSockets[SIMPLE_NB_MUX_COUNT];
+  String                  certificates[SIMPLE_NB_MUX_COUNT];
+  uint8_t                 sock_failed = 0;  // ids to free with +CSOCL
+#ifdef SIMPLE_NB_USE_HTTP
+  SimpleNBFifo<uint8_t, SIMPLE_NB_SIM7020_HTTP_BUFFER> http_rx;
+  int8_t                  http_client   = -1;
+  int                     http_code     = -1;
+  bool                    http_done     = false;
+  bool                    http_overflow = false;  // part of the body lost
+#endif
 };
 
 #endif  // SRC_SIMPLE_NB_CLIENTSim7020_H_
@@ -13,27 +13,63 @@
 
 // #define SIMPLE_NB_DEBUG Serial
 // #define SIMPLE_NB_USE_HEX
+// #define SIMPLE_NB_USE_HTTP
+// #define SIMPLE_NB_USE_MQTT
 
 #define SIMPLE_NB_MUX_COUNT 12
 #define SIMPLE_NB_BUFFER_READ_AND_CHECK_SIZE
 
 #include "SimpleNBClientSIM70xx.h"
 #include "SimpleNBTCP.tpp"
+#include "SimpleNBUDP.tpp"
 #include "SimpleNBSSL.tpp"
 #include "SimpleNBGPS.tpp"
 #include "SimpleNBGSMLocation.tpp"
+#include "SimpleNBBands.tpp"
+#include "SimpleNBPowerSaving.tpp"
+#include "SimpleNBRadioQuality.tpp"
+#include "SimpleNBScheduler.tpp"
+#include "SimpleNBContexts.tpp"
+#ifdef SIMPLE_NB_USE_HTTP
+#include "SimpleNBHttp.tpp"
+#endif
+#ifdef SIMPLE_NB_USE_MQTT
+#include "SimpleNBMqtt.tpp"
+#endif
 #include <ctime>
 
 class SimpleNBSim7080 : public SimpleNBSim70xx<SimpleNBSim7080>,
                        public SimpleNBTCP<SimpleNBSim7080, SIMPLE_NB_MUX_COUNT>,
+                       public SimpleNBUDP<SimpleNBSim7080, SIMPLE_NB_MUX_COUNT>,
                        public SimpleNBSSL<SimpleNBSim7080>,
                        public SimpleNBGSMLocation<SimpleNBSim7080>,
-                      public SimpleNBGPS<SimpleNBSim7080> {
+                      public SimpleNBGPS<SimpleNBSim7080>,
+                      public SimpleNBBands<SimpleNBSim7080>,
+                      public SimpleNBPowerSaving<SimpleNBSim7080>,
+                      public SimpleNBRadioQuality<SimpleNBSim7080>,
+#ifdef SIMPLE_NB_USE_HTTP
+                      public SimpleNBHttp<SimpleNBSim7080>,
+#endif
+#ifdef SIMPLE_NB_USE_MQTT
+                      public SimpleNBMqtt<SimpleNBSim7080>,
+#endif
+                      public SimpleNBContexts<SimpleNBSim7080> {
   friend class SimpleNBSim70xx<SimpleNBSim7080>;
   friend class SimpleNBTCP<SimpleNBSim7080, SIMPLE_NB_MUX_COUNT>;
+  friend class SimpleNBUDP<SimpleNBSim7080, SIMPLE_NB_MUX_COUNT>;
   friend class SimpleNBSSL<SimpleNBSim7080>;
   friend class SimpleNBGPS<SimpleNBSim7080>;
   friend class SimpleNBGSMLocation<SimpleNBSim7080>;
+  friend class SimpleNBBands<SimpleNBSim7080>;
+  friend class SimpleNBPowerSaving<SimpleNBSim7080>;
+  friend class SimpleNBRadioQuality<SimpleNBSim7080>;
+  friend class SimpleNBContexts<SimpleNBSim7080>;
+#ifdef SIMPLE_NB_USE_HTTP
+  friend class SimpleNBHttp<SimpleNBSim7080>;
+#endif
+#ifdef SIMPLE_NB_USE_MQTT
+  friend class SimpleNBMqtt<SimpleNBSim7080>;
+#endif
 
 
   /*
@@ -73,10 +109,20 @@ class SimpleNBSim7080 : public SimpleNBSim70xx<SimpleNBSim7080>,
       SIMPLE_NB_YIELD();
       rx.clear();
       sock_connected = at->modemConnect(host, port, mux, false, timeout_s);
+      if (!sock_connected) { at->connectFailed(mux); }
       return sock_connected;
     }
     SIMPLE_NB_CLIENT_CONNECT_OVERRIDES
 
+    int connectAsync(const char* host, uint16_t port) override {
+      stop();
+      SIMPLE_NB_YIELD();
+      rx.clear();
+      sock_connected = false;
+      bool accepted = at->modemConnect(host, port, mux, false, 75, true);
+      return connectStarted(accepted, 75);
+    }
+
     void stop(uint32_t maxWaitMs) {
       dumpModemBuffer(maxWaitMs);
       at->sendAT(GF("+CACLOSE="), mux);
@@ -119,6 +165,15 @@ class SimpleNBSim7080 : public SimpleNBSim70xx<SimpleNBSim7080>,
       return sock_connected;
     }
     SIMPLE_NB_CLIENT_CONNECT_OVERRIDES
+
+    int connectAsync(const char* host, uint16_t port) override {
+      stop();
+      SIMPLE_NB_YIELD();
+      rx.clear();
+      sock_connected = false;
+      bool accepted = at->modemConnect(host, port, mux, true, 75, true);
+      return connectStarted(accepted, 75);
+    }
   };
 
   /*
@@ -129,6 +184,7 @@ class SimpleNBSim7080 : public SimpleNBSim70xx<SimpleNBSim7080>,
       : SimpleNBSim70xx<SimpleNBSim7080>(stream),
         certificates() {
     memset(sockets, 0, sizeof(sockets));
+    memset(udpSockets, 0, sizeof(udpSockets));
   }
 
   /*
@@ -145,21 +201,22 @@ class SimpleNBSim7080 : public SimpleNBSim70xx<SimpleNBSim7080>,
     if (waitResponse() != 1) { return false; }
 
 #ifdef SIMPLE_NB_DEBUG
-    sendAT(GF("+CMEE=2"));  // turn on verbose error codes
+    sendATSetting(1000L, GF("+CMEE=2"));  // turn on verbose error codes
 #else
-    sendAT(GF("+CMEE=0"));  // turn off error codes
+    sendATSetting(1000L, GF("+CMEE=0"));  // turn off error codes
 #endif
-    waitResponse();
 
     getModemName();
 
     // Enable Local Time Stamp for getting network time
-    sendAT(GF("+CLTS=1"));
-    if (waitResponse(10000L) != 1) { return false; }
+    if (!sendATSetting(10000L, GF("+CLTS=1"))) { return false; }
 
     // Enable battery checks
-    sendAT(GF("+CBATCHK=1"));
-    if (waitResponse() != 1) { return false; }
+    if (!sendATSetting(1000L, GF("+CBATCHK=1"))) { return false; }
+
+    // Report registration changes, with the serving cell, as they happen
+    enableRegistrationUrc(GF("+CEREG=2"));
+    enableRegistrationUrc(GF("+CGREG=2"));
 
     SimStatus ret = getSimStatus();
     // if the sim isn't ready and a pin has been provided, try to unlock the sim
@@ -173,6 +230,14 @@ class SimpleNBSim7080 : public SimpleNBSim70xx<SimpleNBSim7080>,
     }
   }
 
+  // Warm start, the settings of the full init were saved with AT&W
+  bool fastStartImpl() {
+    if (!testAT()) { return false; }
+    return checkSettings(GF("+CMEE?;+CLTS?;+CBATCHK?;+CPIN?"),
+                         SIMPLE_NB_CMEE_REPLY, "+CLTS: 1", "+CBATCHK: 1",
+                         "+CPIN: READY");
+  }
+
   void maintainImpl() {
     // Keep listening for modem URC's and proactively iterate through
     // sockets asking if any data is avaiable
@@ -207,31 +272,22 @@ public:
     // <action> 0: Deactive
     //          1: Active
     //          2: Auto Active
-    bool res    = false;
-    int  ntries = 0;
-    while (!res && ntries < 5) {
-      sendAT(GF("+CNACT=0,1"));
-      res = waitResponse(60000L, GF(ACK_NL "+APP PDP: 0,ACTIVE"), GF(ACK_NL "+APP PDP: 0,DEACTIVE"));
-      waitResponse();
-      ntries++;
-    }
-    return res;
+    // Nothing to do if the context is still up, e.g. after a warm restart
+    if (isDataActive()) { return true; }
+    return activateContextImpl(0);
   }
 
   bool deactivateDataNetwork() {
-    sendAT(GF("+CNACT=0,0"));
-    if (waitResponse(60000L) != 1) { return false; }
-    return true;
+    return deactivateContextImpl(0);
   }
 
-  // Checks if current attached to GPRS/EPS service
+  // Checks if the data context is active, from the state kept from the
+  // +APP PDP URCs once known, otherwise with +CNACT?
   bool isDataActive() {
-    sendAT(GF("+CGATT?"));
-    if (waitResponse(GF("+CGATT:")) != 1) { return false; }
-    int8_t res = streamGetIntBefore('\n');
-    waitResponse();
-    if (res != 1) { return false; }
-    return localIP() != IPAddress(0, 0, 0, 0);
+    int8_t state = dataState();
+    if (state >= 0) { return state == 1; }
+    String ip;
+    return queryContextImpl(0, ip);
   }
 
   int16_t getNetworkMode() {
@@ -305,6 +361,172 @@ public:
     return true;
   }
 
+#ifdef SIMPLE_NB_USE_HTTP
+  /*
+   * HTTP functions
+   */
+ protected:
+  bool httpConnectImpl() {
+    if (http_ssl) {
+      // SSL context 1, so it doesn't touch the one of the TCP clients
+      if (!sendATIndexedSetting(5000L, 2, GF("+CSSLCFG=\"sslversion\",1,3"))) {
+        return false;
+      }
+      sendATIndexedSetting(1000L, 2, GF("+CSSLCFG=\"sni\",1,\""), http_host,
+                           '"');
+      // AT+SHSSL=<index>,<calist>, the name of the CA file on the modem;
+      // none, with httpSetInsecure(), skips the server check
+      sendAT(GF("+SHSSL=1,\""), http_ca, '"');
+      if (waitResponse() != 1) { return false; }
+    }
+    sendAT(GF("+SHCONF=\"URL\",\""), http_ssl ? "https://" : "http://",
+           http_host, ':', http_port, '"');
+    if (waitResponse() != 1) { return false; }
+    // The largest request body and headers the modem takes
+    sendATIndexedSetting(1000L, 1, GF("+SHCONF=\"BODYLEN\",4096"));
+    sendATIndexedSetting(1000L, 1, GF("+SHCONF=\"HEADERLEN\",350"));
+    sendAT(GF("+SHCONN"));
+    return waitResponse(SIMPLE_NB_HTTP_TIMEOUT) == 1;
+  }
+
+  int httpSendImpl(HttpMethod method, const String& path, const uint8_t* body,
+                   size_t len, const char* content_type) {
+    // <type> 1: GET, 2: PUT, 3: POST
+    static const int8_t types[] = {1, 3, 2, -1};
+    if (types[method] < 0) { return -1; }
+    sendAT(GF("+SHCHEAD"));
+    waitResponse();
+    for (uint8_t i = 0; i < http_header_count; i++) {
+      sendAT(GF("+SHAHEAD=\""), http_headers[i][0], GF("\",\""),
+             http_headers[i][1], '"');
+      if (waitResponse() != 1) { return -1; }
+    }
+    if (body && len) {
+      if (content_type) {
+        sendAT(GF("+SHAHEAD=\"Content-Type\",\""), content_type, '"');
+        waitResponse();
+      }
+      // AT+SHBOD=<length>,<timeout>, the body follows the prompt
+      sendAT(GF("+SHBOD="), (uint16_t)len, GF(",10000"));
+      if (waitResponse(GF(">")) != 1) { return -1; }
+      stream.write(body, len);
+      stream.flush();
+      if (waitResponse(10000L) != 1) { return -1; }
+    }
+    sendAT(GF("+SHREQ=\""), path, GF("\","), types[method]);
+    if (waitResponse() != 1) { return -1; }
+    // +SHREQ: "<type>",<status>,<length>
+    if (waitResponse(SIMPLE_NB_HTTP_TIMEOUT, GF(ACK_NL "+SHREQ:")) != 1) {
+      return -1;
+    }
+    streamSkipUntil(',');
+    int status  = streamGetIntBefore(',');
+    http_length = stream.readStringUntil('\n').toInt();
+    return status;
+  }
+
+  // AT+SHREAD=<offset>,<length> answers OK, then +SHREAD: <length> and the
+  // bytes
+  int httpReadImpl(uint8_t* buf, size_t size) {
+    size = SimpleNBMin(size, (size_t)2048);
+    sendAT(GF("+SHREAD="), http_read, ',', (uint16_t)size);
+    if (waitResponse(10000L, GF("+SHREAD:")) != 1) { return 0; }
+    int n = streamGetIntBefore('\n');
+    if (n <= 0) { return 0; }
+    return stream.readBytes(buf, SimpleNBMin((size_t)n, size));
+  }
+
+  void httpCloseImpl() {
+    sendAT(GF("+SHDISC"));
+    waitResponse();
+  }
+#endif
+
+#ifdef SIMPLE_NB_USE_MQTT
+  /*
+   * MQTT functions
+   */
+ protected:
+  // The modem's MQTT client has no context setting, it runs on PDP index 0
+  bool mqttConnectImpl(const char* host, uint16_t port, bool ssl,
+                       const char* client_id, const char* user,
+                       const char* pwd) {
+    if (pdpIndex(mqtt_context) != 0) {
+      DBG("### MQTT only runs on PDP index 0");
+      return false;
+    }
+    sendAT(GF("+SMCONF=\"URL\",\""), host, GF("\","), port);
+    if (waitResponse() != 1) { return false; }
+    sendATIndexedSetting(1000L, 1, GF("+SMCONF=\"KEEPTIME\","), mqtt_keepalive);
+    sendATIndexedSetting(1000L, 1, GF("+SMCONF=\"CLEANSS\",1"));
+    sendATIndexedSetting(1000L, 1, GF("+SMCONF=\"CLIENTID\",\""), client_id,
+                         '"');
+    if (user) {
+      sendATIndexedSetting(1000L, 1, GF("+SMCONF=\"USERNAME\",\""), user, '"');
+      sendATIndexedSetting(1000L, 1, GF("+SMCONF=\"PASSWORD\",\""),
+                           pwd ? pwd : "", '"');
+    }
+    // Received payloads as hex strings, so they may hold quotes and line
+    // ends; older firmware doesn't know SUBHEX and sends them as they are
+    mqtt_hex = sendATIndexedSetting(1000L, 1, GF("+SMCONF=\"SUBHEX\",1"));
+    if (ssl) {
+      // SSL context 1, so it doesn't touch the one of the TCP clients
+      sendATIndexedSetting(5000L, 2, GF("+CSSLCFG=\"sslversion\",1,3"));
+      // AT+SMSSL=<index>,<calist>,<certname>, no CA list, with
+      // mqttSetInsecure(), skips the server check
+      sendAT(GF("+SMSSL=1,\""), mqtt_ca, GF("\",\"\""));
+      if (waitResponse() != 1) { return false; }
+    }
+    sendAT(GF("+SMCONN"));
+    return waitResponse(SIMPLE_NB_MQTT_TIMEOUT) == 1;
+  }
+
+  void mqttDisconnectImpl() {
+    sendAT(GF("+SMDISC"));
+    waitResponse();
+  }
+
+  // AT+SMPUB="<topic>",<length>,<qos>,<retain>, the payload follows the
+  // prompt
+  bool mqttPublishImpl(const char* topic, const uint8_t* payload, size_t len,
+                       uint8_t qos, bool retain) {
+    sendAT(GF("+SMPUB=\""), topic, GF("\","), (uint16_t)len, ',', qos, ',',
+           retain);
+    if (waitResponse(GF(">")) != 1) { return false; }
+    stream.write(payload, len);
+    stream.flush();
+    return waitResponse(10000L) == 1;
+  }
+
+  bool mqttSubscribeImpl(const char* topic, uint8_t qos) {
+    sendAT(GF("+SMSUB=\""), topic, GF("\","), qos);
+    return waitResponse(10000L) == 1;
+  }
+
+  bool mqttUnsubscribeImpl(const char* topic) {
+    sendAT(GF("+SMUNSUB=\""), topic, '"');
+    return waitResponse(10000L) == 1;
+  }
+
+  // +SMSUB: "<topic>","<message>", the message as hex with SUBHEX
+  void parseMqttMessage() {
+    streamSkipUntil('"');
+    String topic = stream.readStringUntil('"');
+    streamSkipUntil('"');
+    String msg = stream.readStringUntil('\n');
+    msg.trim();
+    if (msg.endsWith("\"")) { msg.remove(msg.length() - 1); }
+    if (mqtt_hex) {
+      size_t len = msg.length() / 2;
+      for (size_t i = 0; i < len; i++) {
+        msg[i] = SimpleNBHexByte(msg[2 * i], msg[2 * i + 1]);
+      }
+      msg.remove(len);
+    }
+    queueMqttMessage(topic, (const uint8_t*)msg.c_str(), msg.length());
+  }
+#endif
+
   /*
    * GPRS functions
    */
@@ -314,6 +536,62 @@ public:
 
   bool gprsDisconnectImpl() SIMPLE_NB_ATTR_NOT_IMPLEMENTED;
 
+  /*
+   * Data context functions
+   */
+ protected:
+  bool defineContextImpl(uint8_t cid, const char* apn, const char* user,
+                         const char* pwd) {
+    // AT+CNCFG=<pdpidx>,<ip_type>,<APN>[,<usename>,<password>[,<auth>]]
+    // <ip_type> 1: IPv4
+    // <auth> 0: None, 3: PAP or CHAP
+    if (user && strlen(user) > 0) {
+      sendAT(GF("+CNCFG="), cid, GF(",1,\""), apn, GF("\",\""), user,
+             GF("\",\""), pwd ? pwd : "", GF("\",3"));
+    } else {
+      sendAT(GF("+CNCFG="), cid, GF(",1,\""), apn, '"');
+    }
+    return waitResponse() == 1;
+  }
+
+  bool activateContextImpl(uint8_t cid) {
+    for (int ntries = 0; ntries < 5; ntries++) {
+      sendAT(GF("+CNACT="), cid, GF(",1"));
+      // OK comes first, then +APP PDP: <pdpidx>,ACTIVE or DEACTIVE
+      if (waitResponse(60000L, GF(ACK_NL "+APP PDP:"), GFP(ACK_ERROR)) == 1) {
+        parseAppPdp();
+      }
+      if (net.contexts & contextBit(cid)) { return true; }
+    }
+    return false;
+  }
+
+  bool deactivateContextImpl(uint8_t cid) {
+    sendAT(GF("+CNACT="), cid, GF(",0"));
+    if (waitResponse(60000L) != 1) { return false; }
+    setPdpState(cid, false);
+    return true;
+  }
+
+  // +CNACT: <pdpidx>,<status>,"<address>" is listed for every context
+  bool queryContextImpl(uint8_t cid, String& ip) {
+    bool active = false;
+    sendAT(GF("+CNACT?"));
+    while (waitResponse(GF("+CNACT:"), GFP(ACK_OK), GFP(ACK_ERROR)) == 1) {
+      int8_t idx = streamGetIntBefore(',');
+      bool   up  = streamGetIntBefore(',') == 1;
+      streamSkipUntil('"');
+      String addr = stream.readStringUntil('"');
+      streamSkipUntil('\n');
+      if (idx == cid) {
+        active = up;
+        ip     = addr;
+      }
+      if (idx >= 0) { setPdpState(idx, up); }
+    }
+    return active;
+  }
+
   /*
    * SIM card functions
    */
@@ -488,13 +766,14 @@ public:
    * Client related functions
    */
  protected:
+  // With async set this returns once the open command is accepted, the
+  // +CAOPEN URC then completes the socket in waitResponse()
   bool modemConnect(const char* host, uint16_t port, uint8_t mux,
-                    bool ssl = false, int timeout_s = 75) {
+                    bool ssl = false, int timeout_s = 75, bool async = false) {
     uint32_t timeout_ms = ((uint32_t)timeout_s) * 1000;
 
     // set the connection (mux) identifier to use
-    sendAT(GF("+CACID="), mux);
-    if (waitResponse(timeout_ms) != 1) return false;
+    if (!sendATSetting(timeout_ms, GF("+CACID="), mux)) return false;
 
     if (ssl) {
       // set the ssl version
@@ -507,8 +786,11 @@ public:
       //              4: QAPI_NET_SSL_PROTOCOL_DTLS_1_0
       //              5: QAPI_NET_SSL_PROTOCOL_DTLS_1_2
       // NOTE:  despite docs using caps, "sslversion" must be in lower case
-      sendAT(GF("+CSSLCFG=\"sslversion\",0,3"));  // TLS 1.2
-      if (waitResponse(5000L) != 1) return false;
+      // TLS 1.2
+      if (!sendATIndexedSetting(5000L, 2,
+                                GF("+CSSLCFG=\"sslversion\",0,3"))) {
+        return false;
+      }
     }
 
     // enable or disable ssl
@@ -516,8 +798,7 @@ public:
     // <cid> Application connection ID (set with AT+CACID above)
     // <sslFlag> 0: Not support SSL
     //           1: Support SSL
-    sendAT(GF("+CASSLCFG="), mux, ',', GF("SSL,"), ssl);
-    waitResponse();
+    sendATIndexedSetting(1000L, 2, GF("+CASSLCFG="), mux, ',', GF("SSL,"), ssl);
 
     if (ssl) {
       // set the PDP context to apply SSL to
@@ -525,31 +806,33 @@ public:
       // <ctxindex> PDP context identifier
       // NOTE:  despite docs using "CRINDEX" in all caps, the module only
       // accepts the command "ctxindex" and it must be in lower case
-      sendAT(GF("+CSSLCFG=\"ctxindex\",0"));
-      if (waitResponse(5000L, GF("+CSSLCFG:")) != 1) return false;
-      streamSkipUntil('\n');  // read out the certificate information
-      waitResponse();
+      // the certificate information it returns is dropped
+      if (!sendATIndexedSetting(5000L, 1, GF("+CSSLCFG=\"ctxindex\",0"))) {
+        return false;
+      }
 
       if (certificates[mux] != "") {
         // apply the correct certificate to the connection
         // AT+CASSLCFG=<cid>,"CACERT",<caname>
         // <cid> Application connection ID (set with AT+CACID above)
         // <certname> certificate name
-        sendAT(GF("+CASSLCFG="), mux, ",CACERT,\"", certificates[mux].c_str(),
-               "\"");
-        if (waitResponse(5000L) != 1) return false;
+        if (!sendATIndexedSetting(5000L, 2, GF("+CASSLCFG="), mux,
+                                  ",CACERT,\"", certificates[mux].c_str(),
+                                  "\"")) {
+          return false;
+        }
       }
 
       // set the SSL SNI (server name indication)
       // NOTE:  despite docs using caps, "sni" must be in lower case
-      sendAT(GF("+CSSLCFG=\"sni\","), mux, ',', GF("\""), host, GF("\""));
-      waitResponse();
+      sendATIndexedSetting(1000L, 2, GF("+CSSLCFG=\"sni\","), mux, ',',
+                           GF("\""), host, GF("\""));
     }
 
     // actually open the connection
     // AT+CAOPEN=<cid>,<pdp_index>,<conn_type>,<server>,<port>[,<recv_mode>]
     // <cid> TCP/UDP identifier
-    // <pdp_index> Index of PDP connection; we set up PCP context 1 above
+    // <pdp_index> Index of PDP connection, the one set with setContext()
     // <conn_type> "TCP" or "UDP"
     // <recv_mode> 0: The received data can only be read manually using
     // AT+CARECV=<cid>
@@ -558,8 +841,12 @@ public:
     //                +CAURC:
     //                "recv",<id>,<length>,<remoteIP>,<remote_port><CR><LF><data>
     // NOTE:  including the <recv_mode> fails
-    sendAT(GF("+CAOPEN="), mux, GF(",0,\"TCP\",\""), host, GF("\","), port);
-    if (waitResponse(timeout_ms, GF(ACK_NL "+CAOPEN:")) != 1) { return 0; }
+    // Plain TCP goes to the cached address, TLS keeps the name
+    String addr = ssl ? String(host)
+                      : connectHost(host, mux, sockets[mux]->context);
+    sendAT(GF("+CAOPEN="), mux, ',', pdpIndex(sockets[mux]->context),
+           GF(",\"TCP\",\""), addr, GF("\","), port);
+    if (async) { return waitResponse() == 1; }
     // returns OK/r/n/r/n+CAOPEN: <cid>,<result>
     // <result> 0: Success
     //          1: Socket error
@@ -577,16 +864,16 @@ public:
     //          25: Certificate’s common name does not match
     //          26: Certificate’s common name does not match and time expired
     //          27: Connect failed
-    streamSkipUntil(',');  // Skip mux
-
-    // make sure the connection really opened
-    int8_t res = streamGetIntBefore('\n');
+    int16_t res = waitOpenResult(mux, timeout_ms, GF(ACK_NL "+CAOPEN:"));
+    if (res < 0) { return 0; }
     waitResponse();
 
     return 0 == res;
   }
 
   int16_t modemSend(const void* buff, size_t len, uint8_t mux) {
+    // AT+CNBIOTRAI=<rai> applies to the sends that follow, NB-IoT only
+    applyReleaseAssist(GF("+CNBIOTRAI="));
     // send data on prompt
     sendAT(GF("+CASEND="), mux, ',', (uint16_t)len);
     if (waitResponse(GF(">")) != 1) { return 0; }
@@ -637,7 +924,7 @@ public:
         SIMPLE_NB_YIELD();
       }
       char c = stream.read();
-      sockets[mux]->rx.put(c);
+      sockets[mux]->put(c);
     }
     waitResponse();
     // make sure the sock available number is accurate again
@@ -741,6 +1028,77 @@ public:
     return sockets[mux]->sock_connected;
   }
 
+  // UDP connections are opened towards a single peer, endPacket() (re)opens
+  // the connection whenever the destination changes
+  bool modemUdpBegin(uint8_t, uint16_t localPort) {
+    if (localPort) { DBG("### Local UDP port is chosen by the SIM7080"); }
+    return true;
+  }
+
+  size_t modemUdpSend(uint8_t mux, const char* host, uint16_t port,
+                      const uint8_t* buff, size_t len) {
+    GsmUdp* udp = udpSockets[mux];
+    if (udp->peer_port != port || udp->peer_host != host) {
+      if (udp->peer_port) { modemUdpStop(mux); }
+      // The connection id may have been used for SSL before
+      sendATIndexedSetting(1000L, 2, GF("+CASSLCFG="), mux, ',', GF("SSL,0"));
+      // AT+CAOPEN=<cid>,<pdp_index>,<conn_type>,<server>,<port>
+      sendAT(GF("+CAOPEN="), mux, ',', pdpIndex(udp->context),
+             GF(",\"UDP\",\""), host, GF("\","), port);
+      int16_t res = waitOpenResult(mux, 75000L, GF(ACK_NL "+CAOPEN:"));
+      if (res < 0) { return 0; }
+      waitResponse();
+      if (res != 0) { return 0; }
+      udp->peer_host = host;
+      udp->peer_port = port;
+    }
+    return modemSend(buff, len, mux);
+  }
+
+  void modemUdpRead(uint8_t mux) {
+    GsmUdp* udp = udpSockets[mux];
+    if (!udp->peer_port) { return; }
+    IPAddress ip;
+    ip.fromString(udp->peer_host.c_str());
+    // Every AT+CARECV asks for the largest datagram, so each read returns a
+    // single datagram
+    for (int i = 0; i < SIMPLE_NB_UDP_MAX_DATAGRAMS; i++) {
+      sendAT(GF("+CARECV="), mux, GF(",1460"));
+      if (waitResponse(GF("+CARECV:")) != 1) { return; }
+      int16_t len = stream.parseInt();
+      streamSkipUntil(',');  // skip the comma
+      if (len <= 0) {
+        waitResponse();
+        return;
+      }
+      moveDatagramFromStreamToFifo(mux, len, ip, udp->peer_port);
+      waitResponse();
+    }
+  }
+
+  void modemUdpStop(uint8_t mux) {
+    sendAT(GF("+CACLOSE="), mux);
+    waitResponse(3000);
+    udpSockets[mux]->peer_port = 0;
+  }
+
+  // +APP PDP: <pdpidx>,ACTIVE or DEACTIVE
+  void parseAppPdp() {
+    String line = stream.readStringUntil('\n');
+    setPdpState(line.toInt(), line.indexOf("DEACTIVE") < 0);
+  }
+
+  // Context 0 is the one activateDataNetwork() brings up
+  void setPdpState(uint8_t cid, bool active) {
+    setContextState(cid, active);
+    if (cid == 0) { setDataActive(active); }
+  }
+
+  // Context a socket was bound to with setContext(), 0 if none
+  static uint8_t pdpIndex(int8_t context) {
+    return context < 0 ? 0 : context;
+  }
+
   /*
    * Utilities
    */
@@ -792,6 +1150,11 @@ public:
         } else if (r5 && data.endsWith(r5)) {
           index = 5;
           goto finish;
+        } else if (handleRegistrationUrc(data)) {
+          data = "";
+        } else if (data.endsWith(GF("+APP PDP:"))) {
+          parseAppPdp();
+          data = "";
         } else if (data.endsWith(GF("+CARECV:"))) {
           int8_t  mux = streamGetIntBefore(',');
           int16_t len = streamGetIntBefore('\n');
@@ -801,11 +1164,21 @@ public:
           }
           data = "";
           DBG("### READ:" + String(len) + " on " + String(mux));
+        } else if (data.endsWith(GF(ACK_NL "+CAOPEN:"))) {
+          // Outcome of an asynchronous open, +CAOPEN: <cid>,<result>
+          int8_t  mux = streamGetIntBefore(',');
+          int16_t res = streamGetIntBefore('\n');
+          asyncOpenDone(mux, 0 == res);
+          data = "";
+          DBG("### URC OPEN:", mux, res);
         } else if (data.endsWith(GF("+CADATAIND:"))) {
           int8_t mux = streamGetIntBefore('\n');
           if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && sockets[mux]) {
             sockets[mux]->got_data = true;
           }
+          if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && udpSockets[mux]) {
+            udpSockets[mux]->got_data = true;
+          }
           data = "";
           DBG("### Got Data on socket: " + String(mux));
         } else if (data.endsWith(GF("+CASTATE:"))) {
@@ -817,25 +1190,42 @@ public:
               DBG("### Closed socket:", mux);
             }
           }
+          if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && udpSockets[mux] &&
+              state != 1) {
+            udpSockets[mux]->peer_port = 0;
+          }
+          data = "";
+#ifdef SIMPLE_NB_USE_MQTT
+        } else if (data.endsWith(GF("+SMSUB:"))) {
+          parseMqttMessage();
           data = "";
+          DBG("### MQTT message received");
+        } else if (data.endsWith(GF("+SMSTATE:"))) {
+          // +SMSTATE: 0 when the session with the broker is lost
+          setMqttState(streamGetIntBefore('\n') != 0);
+          data = "";
+#endif
         } else if (data.endsWith(GF("*PSNWID:"))) {
-          streamSkipUntil('\n');  // Refresh network name by network
+          parseNetworkName();  // Refresh network name by network
           data = "";
           DBG("### Network name updated.");
         } else if (data.endsWith(GF("*PSUTTZ:"))) {
-          streamSkipUntil('\n');  // Refresh time and time zone by network
+          parseNetworkTime();  // Refresh time and time zone by network
           data = "";
           DBG("### Network time and time zone updated.");
         } else if (data.endsWith(GF("+CTZV:"))) {
-          streamSkipUntil('\n');  // Refresh network time zone by network
+          parseTimeZone();  // Refresh network time zone by network
           data = "";
           DBG("### Network time zone updated.");
         } else if (data.endsWith(GF("DST: "))) {
-          streamSkipUntil(
-              '\n');  // Refresh Network Daylight Saving Time by network
+          parseDaylightSaving();  // Refresh daylight saving time by network
           data = "";
           DBG("### Daylight savings time state updated.");
+        } else if (data.endsWith(GF("+CPSMSTATUS:"))) {
+          parsePsmStatus();
+          data = "";
         } else if (data.endsWith(GF(ACK_NL "SMS Ready" ACK_NL))) {
+          clearSettingsShadow();  // the modem has restarted
           data = "";
           DBG("### Unexpected module reset!");
           init();
@@ -881,7 +1271,11 @@ public:
 
  protected:
   GsmClientSim7080* sockets[SIMPLE_NB_MUX_COUNT];
+  GsmUdp*           udpSockets[SIMPLE_NB_MUX_COUNT];
   String            certificates[SIMPLE_NB_MUX_COUNT];
+#ifdef SIMPLE_NB_USE_MQTT
+  bool              mqtt_hex = false;  // +SMSUB payloads come as hex
+#endif
 };
 
 #endif  // SRC_SIMPLE_NB_CLIENTSIM7080_H_
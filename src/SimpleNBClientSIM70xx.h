@@ -19,6 +19,10 @@
 #include "SimpleNBSMS.tpp"
 #include "SimpleNBTime.tpp"
 #include "SimpleNBNTP.tpp"
+#include "SimpleNBDNS.tpp"
+#include "SimpleNBBands.tpp"
+#include "SimpleNBPowerSaving.tpp"
+#include "SimpleNBRadioQuality.tpp"
 
 #define ACK_NL "\r\n"
 static const char ACK_OK[] SIMPLE_NB_PROGMEM    = "OK" ACK_NL;
@@ -43,13 +47,15 @@ class SimpleNBSim70xx:public SimpleNBModem<SimpleNBSim70xx<modemType>>,
                       public SimpleNBSMS<SimpleNBSim70xx<modemType>>,
                       public SimpleNBTime<SimpleNBSim70xx<modemType>>,
                       public SimpleNBNTP<SimpleNBSim70xx<modemType>>,
-                      public SimpleNBBattery<SimpleNBSim70xx<modemType>>
+                      public SimpleNBBattery<SimpleNBSim70xx<modemType>>,
+                      public SimpleNBDNS<SimpleNBSim70xx<modemType>>
 {
   friend class SimpleNBModem<SimpleNBSim70xx<modemType>>;
   friend class SimpleNBSMS<SimpleNBSim70xx<modemType>>;
   friend class SimpleNBTime<SimpleNBSim70xx<modemType>>;
   friend class SimpleNBNTP<SimpleNBSim70xx<modemType>>;
   friend class SimpleNBBattery<SimpleNBSim70xx<modemType>>;
+  friend class SimpleNBDNS<SimpleNBSim70xx<modemType>>;
 
   /*
    * CRTP Helper
@@ -76,6 +82,10 @@ class SimpleNBSim70xx:public SimpleNBModem<SimpleNBSim70xx<modemType>>,
     return thisModem().initImpl(pin);
   }
 
+  bool fastStartImpl() {
+    return thisModem().fastStartImpl();
+  }
+
   String getModemNameImpl() {
     String name = "SIMCom SIM70XX";
 
@@ -115,7 +125,9 @@ protected:
     thisModem().waitResponse();
     if (!thisModem().setPhoneFunctionality(0)) { return false; }
     if (!thisModem().setPhoneFunctionality(1, true)) { return false; }
-    thisModem().waitResponse(30000L, GF("SMS Ready"));
+    // SMS Ready never comes without a usable SIM, init() then reports why
+    thisModem().waitResponse(30000L, GF("SMS Ready"),
+                             GF("+CPIN: NOT INSERTED"), GF("+CPIN: SIM P"));
     return initImpl(pin);
   }
 
@@ -232,6 +244,188 @@ protected:
    */
   // should implement in sub-classes
 
+  /*
+   * DNS functions
+   */
+ protected:
+  bool resolveImpl(const char* host, int8_t, String& ip, uint32_t&,
+                   uint32_t timeout_ms) {
+    // AT+CDNSGIP=<domain_name>
+    // +CDNSGIP: 1,<domain_name>,<IP1>[,<IP2>] or +CDNSGIP: 0,<dns_error_code>
+    // The modem doesn't report the TTL, nor take the context to look the name
+    // up on
+    thisModem().sendAT(GF("+CDNSGIP=\""), host, '"');
+    if (thisModem().waitResponse() != 1) { return false; }
+    if (thisModem().waitResponse(timeout_ms, GF(ACK_NL "+CDNSGIP:")) != 1) {
+      return false;
+    }
+    if (thisModem().streamGetIntBefore(',') != 1) {
+      thisModem().streamSkipUntil('\n');
+      return false;
+    }
+    thisModem().streamSkipUntil(',');  // Skip the domain name
+    thisModem().streamSkipUntil('"');
+    ip = thisModem().stream.readStringUntil('"');
+    thisModem().streamSkipUntil('\n');  // Skip the optional second address
+    return ip.length() > 0;
+  }
+
+  /*
+   * Band functions
+   */
+ protected:
+  // For the SIM7000 and SIM7070/80/90, the SIM7020 has its own
+  bool setBandMaskImpl(RadioTech rat, const uint64_t mask[2]) {
+    // AT+CBANDCFG=<mode>,<band>[,<band>...]
+    if (rat != RADIO_CATM && rat != RADIO_NBIOT) { return false; }
+    if (!mask[0] && !mask[1]) { return false; }
+    thisModem().sendAT(GF("+CBANDCFG=\""),
+                       rat == RADIO_NBIOT ? GF("NB-IOT") : GF("CAT-M"),
+                       GF("\","), thisModem().maskToList(mask));
+    return thisModem().waitResponse() == 1;
+  }
+
+  bool getBandMaskImpl(RadioTech rat, uint64_t mask[2]) {
+    // +CBANDCFG: "CAT-M",1,2,3,... on one line and "NB-IOT",... on the next
+    if (rat != RADIO_CATM && rat != RADIO_NBIOT) { return false; }
+    thisModem().sendAT(GF("+CBANDCFG?"));
+    if (thisModem().waitResponse(rat == RADIO_NBIOT
+                                     ? GF("+CBANDCFG: \"NB-IOT\"")
+                                     : GF("+CBANDCFG: \"CAT-M\"")) != 1) {
+      return false;
+    }
+    thisModem().listToMask(thisModem().stream.readStringUntil('\n'), mask);
+    thisModem().waitResponse();
+    return true;
+  }
+
+  // The modem can leave radio technologies out, but not change the order
+  // in which it searches them
+  bool setScanSequenceImpl(RadioTech first, RadioTech second,
+                           RadioTech third) {
+    bool gsm  = thisModem().hasRadio(RADIO_GSM, first, second, third);
+    bool catm = thisModem().hasRadio(RADIO_CATM, first, second, third);
+    bool nb   = thisModem().hasRadio(RADIO_NBIOT, first, second, third);
+    if (!gsm && !catm && !nb) { return false; }
+    // 13 GSM only, 38 LTE only, 51 GSM and LTE
+    thisModem().sendAT(GF("+CNMP="), !catm && !nb ? 13 : gsm ? 51 : 38);
+    if (thisModem().waitResponse() != 1) { return false; }
+    if (!catm && !nb) { return true; }
+    // 1 CAT-M, 2 NB-IoT, 3 CAT-M and NB-IoT
+    thisModem().sendAT(GF("+CMNB="), catm && nb ? 3 : catm ? 1 : 2);
+    return thisModem().waitResponse() == 1;
+  }
+
+  bool getServingCellImpl(AttachInfo_t& info) {
+    // +CPSI: LTE NB-IOT,Online,460-11,0x1A2B,12345678,123,EUTRAN-BAND8,3734,...
+    thisModem().sendAT(GF("+CPSI?"));
+    if (thisModem().waitResponse(GF("+CPSI:")) != 1) { return false; }
+    String line = thisModem().stream.readStringUntil('\n');
+    thisModem().waitResponse();
+    int band = line.indexOf("BAND");
+    if (line.indexOf("Online") < 0 || band < 0) { return false; }
+    info.rat    = line.indexOf("NB") >= 0 ? RADIO_NBIOT : RADIO_CATM;
+    info.band   = line.substring(band + 4).toInt();
+    info.earfcn = line.substring(line.indexOf(',', band) + 1).toInt();
+    return info.band != 0;
+  }
+
+  /*
+   * Radio quality functions
+   */
+ protected:
+  bool sampleRadioQualityImpl(RadioQuality_t& sample) {
+    // +CPSI: <mode>,<op_mode>,<mcc>-<mnc>,<tac>,<cell_id>,<pci>,<band>,
+    // <earfcn>,<dlbw>,<ulbw>,<rsrq>,<rsrp>,<rssi>,<rssnr>
+    thisModem().sendAT(GF("+CPSI?"));
+    if (thisModem().waitResponse(GF("+CPSI:")) != 1) { return false; }
+    String line = thisModem().stream.readStringUntil('\n');
+    thisModem().waitResponse();
+    if (line.indexOf("LTE") < 0 || line.indexOf("Online") < 0) {
+      return false;
+    }
+    String band   = thisModem().csvField(line, 6);
+    sample.rat    = line.indexOf("NB") >= 0 ? RADIO_NBIOT : RADIO_CATM;
+    sample.cell   = thisModem().csvField(line, 4).toInt();
+    sample.band   = band.substring(band.indexOf("BAND") + 4).toInt();
+    sample.earfcn = thisModem().csvField(line, 7).toInt();
+    sample.rsrq   = thisModem().csvField(line, 10).toFloat();
+    sample.rsrp   = thisModem().csvField(line, 11).toFloat();
+    sample.sinr   = thisModem().csvField(line, 13).toFloat();
+    // The CE level isn't reported
+    return sample.rsrp != 0;
+  }
+
+  /*
+   * Power saving functions
+   */
+ protected:
+  bool psmUrcImpl(bool enable) {
+    return this->sendATSetting(1000L, GF("+CPSMSTATUS="), enable);
+  }
+
+  /*
+   * Network state functions
+   */
+ protected:
+  // The URCs below come unasked once the modem is registered, the handlers
+  // of the sub-classes call these to keep what they tell
+
+  // *PSNWID: "<mcc>","<mnc>","<full name>",<ci>,"<short name>",<ci>
+  void parseNetworkName() {
+    String line = thisModem().stream.readStringUntil('\n');
+    String field[3];
+    int    from = 0;
+    for (uint8_t i = 0; i < 3; i++) {
+      int open  = line.indexOf('"', from);
+      int close = line.indexOf('"', open + 1);
+      if (open < 0 || close < 0) { return; }
+      field[i] = line.substring(open + 1, close);
+      from     = close + 1;
+    }
+    this->net.mcc           = field[0].toInt();
+    this->net.mnc           = field[1].toInt();
+    this->net.operator_name = field[2];
+  }
+
+  // *PSUTTZ: <year>,<month>,<day>,<hour>,<min>,<sec>,"<tz>",<dst>
+  // The time is in UTC, the time zone in quarter hours
+  void parseNetworkTime() {
+    String line = thisModem().stream.readStringUntil('\n');
+    int    v[8];
+    uint8_t n = SimpleNBParseInts(line, v, 8);
+    if (n < 7) { return; }
+    this->net.year     = v[0] < 100 ? v[0] + 2000 : v[0];
+    this->net.month    = v[1];
+    this->net.day      = v[2];
+    this->net.hour     = v[3];
+    this->net.minute   = v[4];
+    this->net.second   = v[5];
+    this->net.timezone = v[6];
+    if (n > 7) { this->net.dst = v[7]; }
+    this->net.has_time = true;
+    this->net.time_at  = millis();
+  }
+
+  // +CTZV: <tz>
+  void parseTimeZone() {
+    String line = thisModem().stream.readStringUntil('\n');
+    int    tz;
+    if (SimpleNBParseInts(line, &tz, 1)) { this->net.timezone = tz; }
+  }
+
+  // DST: <dst>
+  void parseDaylightSaving() {
+    this->net.dst = thisModem().streamGetIntBefore('\n');
+  }
+
+  // +CPSMSTATUS: "ENTER PSM" or "EXIT PSM"
+  void parsePsmStatus() {
+    String line = thisModem().stream.readStringUntil('\n');
+    line.toUpperCase();
+    this->setPsmState(line.indexOf("ENTER") >= 0);
+  }
+
   /*
    * Utilities
    */
@@ -23,9 +23,16 @@
 #include "SimpleNBModem.tpp"
 #include "SimpleNBSMS.tpp"
 #include "SimpleNBSSL.tpp"
+#include "SimpleNBDNS.tpp"
 #include "SimpleNBTCP.tpp"
+#include "SimpleNBUDP.tpp"
+#include "SimpleNBUbloxUDP.tpp"
 #include "SimpleNBTemperature.tpp"
 #include "SimpleNBTime.tpp"
+#include "SimpleNBBands.tpp"
+#include "SimpleNBPowerSaving.tpp"
+#include "SimpleNBRadioQuality.tpp"
+#include "SimpleNBScheduler.tpp"
 
 #define ACK_NL "\r\n"
 static const char ACK_OK[] SIMPLE_NB_PROGMEM    = "OK" ACK_NL;
@@ -47,15 +54,23 @@ enum RegStatus {
 
 class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
                       public SimpleNBTCP<SimpleNBSaraR4, SIMPLE_NB_MUX_COUNT>,
+                      public SimpleNBUDP<SimpleNBSaraR4, SIMPLE_NB_MUX_COUNT>,
+                       public SimpleNBUbloxUDP<SimpleNBSaraR4>,
                       public SimpleNBSSL<SimpleNBSaraR4>,
                       public SimpleNBBattery<SimpleNBSaraR4>,
                       public SimpleNBGSMLocation<SimpleNBSaraR4>,
                       public SimpleNBGPS<SimpleNBSaraR4>,
                       public SimpleNBSMS<SimpleNBSaraR4>,
                       public SimpleNBTemperature<SimpleNBSaraR4>,
-                      public SimpleNBTime<SimpleNBSaraR4> {
+                      public SimpleNBTime<SimpleNBSaraR4>,
+                      public SimpleNBDNS<SimpleNBSaraR4>,
+                      public SimpleNBBands<SimpleNBSaraR4>,
+                      public SimpleNBPowerSaving<SimpleNBSaraR4>,
+                      public SimpleNBRadioQuality<SimpleNBSaraR4> {
   friend class SimpleNBModem<SimpleNBSaraR4>;
   friend class SimpleNBTCP<SimpleNBSaraR4, SIMPLE_NB_MUX_COUNT>;
+  friend class SimpleNBUDP<SimpleNBSaraR4, SIMPLE_NB_MUX_COUNT>;
+  friend class SimpleNBUbloxUDP<SimpleNBSaraR4>;
   friend class SimpleNBSSL<SimpleNBSaraR4>;
   friend class SimpleNBBattery<SimpleNBSaraR4>;
   friend class SimpleNBGSMLocation<SimpleNBSaraR4>;
@@ -63,6 +78,10 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
   friend class SimpleNBSMS<SimpleNBSaraR4>;
   friend class SimpleNBTemperature<SimpleNBSaraR4>;
   friend class SimpleNBTime<SimpleNBSaraR4>;
+  friend class SimpleNBDNS<SimpleNBSaraR4>;
+  friend class SimpleNBBands<SimpleNBSaraR4>;
+  friend class SimpleNBPowerSaving<SimpleNBSaraR4>;
+  friend class SimpleNBRadioQuality<SimpleNBSaraR4>;
 
   /*
    * Inner Client
@@ -103,6 +122,7 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
 
       uint8_t oldMux = mux;
       sock_connected = at->modemConnect(host, port, &mux, false, timeout_s);
+      if (!sock_connected) { at->connectFailed(mux); }
       if (mux != oldMux) {
         DBG("WARNING:  Mux number changed from", oldMux, "to", mux);
         at->sockets[oldMux] = NULL;
@@ -122,6 +142,25 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
       return connect(ip, port, 120);
     }
 
+    int connectAsync(const char* host, uint16_t port) override {
+      // Only a blocking open on the SARA-R404M / SARA-R410M-01B
+      if (!at->supportsAsyncSockets) {
+        return GsmClient::connectAsync(host, port);
+      }
+      SIMPLE_NB_YIELD();
+      rx.clear();
+      sock_connected = false;
+      uint8_t oldMux   = mux;
+      bool    accepted = at->modemConnect(host, port, &mux, false, 120,
+                                          true);
+      if (mux != oldMux) {
+        DBG("WARNING:  Mux number changed from", oldMux, "to", mux);
+        at->sockets[oldMux] = NULL;
+      }
+      at->sockets[mux] = this;
+      return connectStarted(accepted, 120);
+    }
+
     void stop(uint32_t maxWaitMs) {
       uint32_t startMillis = millis();
       dumpModemBuffer(maxWaitMs);
@@ -199,6 +238,25 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
     int connect(IPAddress ip, uint16_t port) override {
       return connect(ip, port, 120);
     }
+
+    int connectAsync(const char* host, uint16_t port) override {
+      // Only a blocking open on the SARA-R404M / SARA-R410M-01B
+      if (!at->supportsAsyncSockets) {
+        return GsmClient::connectAsync(host, port);
+      }
+      SIMPLE_NB_YIELD();
+      rx.clear();
+      sock_connected = false;
+      uint8_t oldMux   = mux;
+      bool    accepted = at->modemConnect(host, port, &mux, true, 120,
+                                          true);
+      if (mux != oldMux) {
+        DBG("WARNING:  Mux number changed from", oldMux, "to", mux);
+        at->sockets[oldMux] = NULL;
+      }
+      at->sockets[mux] = this;
+      return connectStarted(accepted, 120);
+    }
   };
 
   /*
@@ -210,6 +268,7 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
         has2GFallback(false),
         supportsAsyncSockets(false) {
     memset(sockets, 0, sizeof(sockets));
+    memset(udpSockets, 0, sizeof(udpSockets));
   }
 
   /*
@@ -226,11 +285,10 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
     if (waitResponse() != 1) { return false; }
 
 #ifdef SIMPLE_NB_DEBUG
-    sendAT(GF("+CMEE=2"));  // turn on verbose error codes
+    sendATSetting(1000L, GF("+CMEE=2"));  // turn on verbose error codes
 #else
-    sendAT(GF("+CMEE=0"));  // turn off error codes
+    sendATSetting(1000L, GF("+CMEE=0"));  // turn off error codes
 #endif
-    waitResponse();
 
     String modemName = getModemName();
 
@@ -247,8 +305,11 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
     }
 
     // Enable automatic time zome update
-    sendAT(GF("+CTZU=1"));
-    if (waitResponse(10000L) != 1) { return false; }
+    if (!sendATSetting(10000L, GF("+CTZU=1"))) { return false; }
+
+    // Report registration changes, with the serving cell, as they happen
+    enableRegistrationUrc(GF("+CEREG=2"));
+    enableRegistrationUrc(GF("+CREG=2"));
 
     SimStatus ret = getSimStatus();
     // if the sim isn't ready and a pin has been provided, try to unlock the sim
@@ -299,7 +360,7 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
   bool restartImpl(const char* pin = NULL) {
     if (!testAT()) { return false; }
     if (!setPhoneFunctionality(15)) { return false; }
-    delay(3000);  // TODO(?):  Verify delay timing here
+    waitForReset(3000L);  // init() then waits for it to come back
     return init(pin);
   }
 
@@ -351,6 +412,133 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
     return restart();
   }
 
+  /*
+   * Band functions
+   */
+ protected:
+  // AT+UBANDMASK=<rat>,<mask1>[,<mask2>], rat 0 is CAT-M and 1 NB-IoT, the
+  // masks are in decimal. Takes effect after a restart.
+  bool setBandMaskImpl(RadioTech rat, const uint64_t mask[2]) {
+    if (rat != RADIO_CATM && rat != RADIO_NBIOT) { return false; }
+    if (mask[1]) {
+      sendAT(GF("+UBANDMASK="), rat == RADIO_NBIOT, ',', u64ToString(mask[0]),
+             ',', u64ToString(mask[1]));
+    } else {
+      sendAT(GF("+UBANDMASK="), rat == RADIO_NBIOT, ',', u64ToString(mask[0]));
+    }
+    return waitResponse() == 1;
+  }
+
+  bool getBandMaskImpl(RadioTech rat, uint64_t mask[2]) {
+    // +UBANDMASK: 0,<mask1>[,<mask2>],1,<mask1>[,<mask2>]
+    if (rat != RADIO_CATM && rat != RADIO_NBIOT) { return false; }
+    sendAT(GF("+UBANDMASK?"));
+    if (waitResponse(GF("+UBANDMASK:")) != 1) { return false; }
+    String line = stream.readStringUntil('\n');
+    waitResponse();
+    uint64_t values[6];
+    uint8_t  n    = 0;
+    int      from = 0;
+    while (n < 6 && from < (int)line.length()) {
+      values[n++] = stringToU64(line.c_str() + from);
+      from        = line.indexOf(',', from) + 1;
+      if (from == 0) { break; }
+    }
+    // Without the second masks the NB-IoT entry starts at the third value
+    uint8_t stride = n == 6 ? 3 : 2;
+    uint8_t entry  = rat == RADIO_NBIOT ? stride : 0;
+    if (entry + 1 >= n) { return false; }
+    mask[0] = values[entry + 1];
+    mask[1] = stride == 3 ? values[entry + 2] : 0;
+    return true;
+  }
+
+  // The masks wait for a restart, too slow for waitForAttach() to try the
+  // last band first
+  bool bandsApplyNowImpl() {
+    return false;
+  }
+
+  // +URAT=<SelectedAcT>[,<PreferredAct>[,<2ndPreferredAct>]], takes effect
+  // after a restart
+  bool setScanSequenceImpl(RadioTech first, RadioTech second,
+                           RadioTech third) {
+    // 7 CAT-M, 8 NB-IoT, 9 GPRS
+    static const uint8_t urat[] = {0, 9, 7, 8};
+    if (first == RADIO_NONE) { return false; }
+    String seq(urat[first]);
+    if (second != RADIO_NONE) {
+      seq += ',';
+      seq += urat[second];
+    }
+    if (third != RADIO_NONE) {
+      seq += ',';
+      seq += urat[third];
+    }
+    sendAT(GF("+COPS=2"));  // Deregister from network
+    if (waitResponse() != 1) { return false; }
+    sendAT(GF("+URAT="), seq);
+    if (waitResponse() != 1) { return false; }
+    sendAT(GF("+COPS=0"));  // Auto-register to the network
+    return waitResponse() == 1;
+  }
+
+  // +COPS: <mode>,<format>,"<oper>",<AcT>, AcT 7 is CAT-M and 9 NB-IoT;
+  // the EARFCN comes from +UCGED
+  bool getServingCellImpl(AttachInfo_t& info) {
+    sendAT(GF("+COPS?"));
+    if (waitResponse(GF("+COPS:")) != 1) { return false; }
+    String line = stream.readStringUntil('\n');
+    waitResponse();
+    int act = line.substring(line.lastIndexOf(',') + 1).toInt();
+    if (act != 7 && act != 9) { return false; }
+    RadioQuality_t sample;
+    if (!sampleRadioQualityImpl(sample) || !sample.band) { return false; }
+    info.rat    = act == 9 ? RADIO_NBIOT : RADIO_CATM;
+    info.band   = sample.band;
+    info.earfcn = sample.earfcn;
+    return true;
+  }
+
+  /*
+   * Radio quality functions
+   */
+ protected:
+  // In the short form of +UCGED=5 the serving cell comes first on each line,
+  // <cell> being the physical cell id:
+  //   +RSRP: <cell>,<earfcn>,"<rsrp>",...
+  //   +RSRQ: <cell>,<earfcn>,"<rsrq>",...
+  // SINR, the CE level and the radio technology are not reported
+  bool sampleRadioQualityImpl(RadioQuality_t& sample) {
+    if (!sendATSetting(1000L, GF("+UCGED=5"))) { return false; }
+    sendAT(GF("+UCGED?"));
+    int8_t res;
+    while ((res = waitResponse(GF("+RSRP:"), GF("+RSRQ:"), GFP(ACK_OK),
+                               GFP(ACK_ERROR))) == 1 || res == 2) {
+      String line  = stream.readStringUntil('\n');
+      float  value = csvField(line, 2).toFloat();
+      if (res == 1) {
+        sample.cell   = line.toInt();
+        sample.earfcn = csvField(line, 1).toInt();
+        sample.rsrp   = value;
+      } else {
+        sample.rsrq = value;
+      }
+    }
+    if (res != 3 || isnan(sample.rsrp)) { return false; }
+    sample.band = bandFromEarfcn(sample.earfcn);
+    return true;
+  }
+
+  /*
+   * Power saving functions
+   */
+ protected:
+  // +UUPSMR: <state>, 1 when entering PSM and 0 once out of it
+  bool psmUrcImpl(bool enable) {
+    return sendATSetting(1000L, GF("+UPSMR="), enable);
+  }
+
   /*
    * GPRS functions
    */
@@ -606,12 +794,30 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
     return temp;
   }
 
+  /*
+   * DNS functions
+   */
+ protected:
+  bool resolveImpl(const char* host, int8_t, String& ip, uint32_t&,
+                   uint32_t timeout_ms) {
+    // AT+UDNSRN=<resolution_type>,<domain_ip_string>
+    // +UDNSRN: <resolved_ip_address>, the TTL is not reported
+    sendAT(GF("+UDNSRN=0,\""), host, '"');
+    if (waitResponse(timeout_ms, GF(ACK_NL "+UDNSRN:")) != 1) { return false; }
+    streamSkipUntil('"');
+    ip = stream.readStringUntil('"');
+    waitResponse();
+    return ip.length() > 0;
+  }
+
   /*
    * Client related functions
    */
  protected:
+  // With async set this returns once the open command is accepted, the
+  // +UUSOCO URC then completes the socket in waitResponse()
   bool modemConnect(const char* host, uint16_t port, uint8_t* mux,
-                    bool ssl = false, int timeout_s = 120) {
+                    bool ssl = false, int timeout_s = 120, bool async = false) {
     uint32_t timeout_ms  = ((uint32_t)timeout_s) * 1000;
     uint32_t startMillis = millis();
 
@@ -639,7 +845,8 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
     // sendAT(GF("+USOSO="), *mux, GF(",6,2,30000"));
     // waitResponse();
 
-    // connect on the allocated socket
+    // connect on the allocated socket, plain TCP goes to the cached address
+    String addr = ssl ? String(host) : connectHost(host, *mux, -1);
 
     // Use an asynchronous open to reduce the number of terminal freeze-ups
     // This is still blocking until the URC arrives
@@ -650,7 +857,8 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
     if (supportsAsyncSockets) {
       DBG("### Opening socket asynchronously!  Socket cannot be used until "
           "the URC '+UUSOCO' appears.");
-      sendAT(GF("+USOCO="), *mux, ",\"", host, "\",", port, ",1");
+      sendAT(GF("+USOCO="), *mux, ",\"", addr, "\",", port, ",1");
+      if (async) { return waitResponse() == 1; }
       if (waitResponse(timeout_ms - (millis() - startMillis),
                        GF(ACK_NL "+UUSOCO:")) == 1) {
         streamGetIntBefore(',');  // skip repeated mux
@@ -664,7 +872,7 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
       }
     } else {
       // use synchronous open
-      sendAT(GF("+USOCO="), *mux, ",\"", host, "\",", port);
+      sendAT(GF("+USOCO="), *mux, ",\"", addr, "\",", port);
       int8_t rsp = waitResponse(timeout_ms - (millis() - startMillis));
       return (1 == rsp);
     }
@@ -681,6 +889,7 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
     streamSkipUntil(',');  // Skip mux
     int16_t sent = streamGetIntBefore('\n');
     waitResponse();  // sends back OK after the confirmation of number sent
+    releaseAfterSend();
     return sent;
   }
 
@@ -744,6 +953,24 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
     return (result != 0);
   }
 
+  // UDP runs on the u-blox socket commands of SimpleNBUbloxUDP, sending
+  // adds the release request
+  size_t modemUdpSend(uint8_t mux, const char* host, uint16_t port,
+                      const uint8_t* buff, size_t len) {
+    size_t sent = SimpleNBUbloxUDP<SimpleNBSaraR4>::modemUdpSend(
+        mux, host, port, buff, len);
+    releaseAfterSend();
+    return sent;
+  }
+
+  // The socket commands take no release assistance, so after the last
+  // packet the standard AT+CNMPSD (no more PS data) asks for the release
+  void releaseAfterSend() {
+    if (uplink_rai != RAI_LAST_PACKET) { return; }
+    sendAT(GF("+CNMPSD"));
+    waitResponse();
+  }
+
   /*
    * Utilities
    */
@@ -795,6 +1022,14 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
         } else if (r5 && data.endsWith(r5)) {
           index = 5;
           goto finish;
+        } else if (handleRegistrationUrc(data)) {
+          data = "";
+        } else if (data.endsWith(GF("+UUPSMR:"))) {
+          bool entered = stream.readStringUntil('\n').toInt() == 1;
+          // The modem wakes from PSM without what was set
+          if (!entered) { clearSettingsShadow(); }
+          setPsmState(entered);
+          data = "";
         } else if (data.endsWith(GF("+UUSORD:"))) {
           int8_t  mux = streamGetIntBefore(',');
           int16_t len = streamGetIntBefore('\n');
@@ -805,22 +1040,37 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
           }
           data = "";
           DBG("### URC Data Received:", len, "on", mux);
+        } else if (data.endsWith(GF("+UUSORF:"))) {
+          int8_t mux = streamGetIntBefore(',');
+          streamSkipUntil('\n');  // the length is taken from +USORF
+          if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && udpSockets[mux]) {
+            udpSockets[mux]->got_data = true;
+          }
+          data = "";
+          DBG("### URC Datagram Received on", mux);
         } else if (data.endsWith(GF("+UUSOCL:"))) {
           int8_t mux = streamGetIntBefore('\n');
           if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && sockets[mux]) {
             sockets[mux]->sock_connected = false;
           }
+          if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && udpSockets[mux]) {
+            udpSockets[mux]->sock_open = false;
+          }
           data = "";
           DBG("### URC Sock Closed: ", mux);
         } else if (data.endsWith(GF("+UUSOCO:"))) {
-          int8_t mux          = streamGetIntBefore('\n');
+          int8_t mux          = streamGetIntBefore(',');
           int8_t socket_error = streamGetIntBefore('\n');
-          if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && sockets[mux] &&
-              socket_error == 0) {
-            sockets[mux]->sock_connected = true;
+          if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && sockets[mux]) {
+            if (sockets[mux]->sock_opening) {
+              if (0 != socket_error) { connectFailed(mux); }
+              sockets[mux]->connectDone(0 == socket_error);
+            } else if (socket_error == 0) {
+              sockets[mux]->sock_connected = true;
+            }
           }
           data = "";
-          DBG("### URC Sock Opened: ", mux);
+          DBG("### URC Sock Opened: ", mux, socket_error);
         }
       }
     } while (millis() - startMillis < timeout_ms);
@@ -865,6 +1115,7 @@ class SimpleNBSaraR4 : public SimpleNBModem<SimpleNBSaraR4>,
 
  protected:
   GsmClientSaraR4* sockets[SIMPLE_NB_MUX_COUNT];
+  GsmUdp*         udpSockets[SIMPLE_NB_MUX_COUNT];
   const char*      gsmNL = ACK_NL;
   bool             has2GFallback;
   bool             supportsAsyncSockets;
@@ -16,11 +16,16 @@
 #define SIMPLE_NB_MUX_COUNT 6
 #define SIMPLE_NB_BUFFER_READ_AND_CHECK_SIZE
 
+// Payloads are sent as raw bytes by default; define this to fall back to
+// sending them as hex strings (twice the bytes over the UART)
+// #define SIMPLE_NB_SEQUANS_HEX_SEND
+
 #include "SimpleNBCalling.tpp"
 #include "SimpleNBModem.tpp"
 #include "SimpleNBSMS.tpp"
 #include "SimpleNBSSL.tpp"
 #include "SimpleNBTCP.tpp"
+#include "SimpleNBUDP.tpp"
 #include "SimpleNBTemperature.tpp"
 #include "SimpleNBTime.tpp"
 
@@ -55,6 +60,7 @@ enum SocketStatus {
 class SimpleNBSequansMonarch :
       public SimpleNBModem<SimpleNBSequansMonarch>,
       public SimpleNBTCP<SimpleNBSequansMonarch, SIMPLE_NB_MUX_COUNT>,
+      public SimpleNBUDP<SimpleNBSequansMonarch, SIMPLE_NB_MUX_COUNT>,
       public SimpleNBSSL<SimpleNBSequansMonarch>,
       public SimpleNBCalling<SimpleNBSequansMonarch>,
       public SimpleNBSMS<SimpleNBSequansMonarch>,
@@ -62,6 +68,7 @@ class SimpleNBSequansMonarch :
       public SimpleNBTemperature<SimpleNBSequansMonarch> {
   friend class SimpleNBModem<SimpleNBSequansMonarch>;
   friend class SimpleNBTCP<SimpleNBSequansMonarch, SIMPLE_NB_MUX_COUNT>;
+  friend class SimpleNBUDP<SimpleNBSequansMonarch, SIMPLE_NB_MUX_COUNT>;
   friend class SimpleNBSSL<SimpleNBSequansMonarch>;
   friend class SimpleNBCalling<SimpleNBSequansMonarch>;
   friend class SimpleNBSMS<SimpleNBSequansMonarch>;
@@ -184,6 +191,7 @@ class SimpleNBSequansMonarch :
  public:
   explicit SimpleNBSequansMonarch(Stream& stream) : stream(stream) {
     memset(sockets, 0, sizeof(sockets));
+    memset(udpSockets, 0, sizeof(udpSockets));
   }
 
   /*
@@ -200,11 +208,10 @@ class SimpleNBSequansMonarch :
     if (waitResponse() != 1) { return false; }
 
 #ifdef SIMPLE_NB_DEBUG
-    sendAT(GF("+CMEE=2"));  // turn on verbose error codes
+    sendATSetting(1000L, GF("+CMEE=2"));  // turn on verbose error codes
 #else
-    sendAT(GF("+CMEE=0"));  // turn off error codes
+    sendATSetting(1000L, GF("+CMEE=0"));  // turn off error codes
 #endif
-    waitResponse();
 
     getModemName();
 
@@ -217,12 +224,13 @@ class SimpleNBSequansMonarch :
     waitResponse();
 
     // Disable time and time zone URC's
-    sendAT(GF("+CTZR=0"));
-    if (waitResponse(10000L) != 1) { return false; }
+    if (!sendATSetting(10000L, GF("+CTZR=0"))) { return false; }
 
     // Enable automatic time zome update
-    sendAT(GF("+CTZU=1"));
-    if (waitResponse(10000L) != 1) { return false; }
+    if (!sendATSetting(10000L, GF("+CTZU=1"))) { return false; }
+
+    // Report registration changes, with the serving cell, as they happen
+    enableRegistrationUrc(GF("+CEREG=2"));
 
     SimStatus ret = getSimStatus();
     // if the sim isn't ready and a pin has been provided, try to unlock the sim
@@ -293,8 +301,7 @@ class SimpleNBSequansMonarch :
     sendAT(GF("+CFUN=1,1"));
     res = waitResponse(20000L, GF("+SYSSTART"), GFP(ACK_ERROR));
     if (res != 1 && res != 3) { return false; }
-    delay(1000);
-    return init(pin);
+    return init(pin);  // init() probes until the modem takes commands
   }
 
   bool powerOffImpl() {
@@ -466,8 +473,12 @@ class SimpleNBSequansMonarch :
     // <recvDataMode1> = Receive data mode = 0  - data as text (1 for hex)
     // <keepalive1> = unused = 0
     // <listenAutoRsp1> = Listen auto-response mode = 0 - deactivated
-    // <sendDataMode1> = Send data mode = 1  - data as hex (0 for text)
+    // <sendDataMode1> = Send data mode = 0  - data as text (1 for hex)
+#if defined SIMPLE_NB_SEQUANS_HEX_SEND
     sendAT(GF("+SQNSCFGEXT="), mux, GF(",1,0,0,0,1"));
+#else
+    sendAT(GF("+SQNSCFGEXT="), mux, GF(",1,0,0,0,0"));
+#endif
     waitResponse(5000L);
 
     // Socket dial
@@ -504,16 +515,20 @@ class SimpleNBSequansMonarch :
       DBG("### Sock closed, cannot send data!");
       return 0;
     }
+    return modemSendExt(buff, len, mux);
+  }
 
+  int modemSendExt(const void* buff, size_t len, uint8_t mux) {
+    // AT+SQNSSENDEXT=<connId>,<bytesToSend>
+    // The length is given up front so, in text mode, the payload is binary
+    // safe and written as is after the prompt
     sendAT(GF("+SQNSSENDEXT="), mux, ',', (uint16_t)len);
-    waitResponse(10000L, GF(ACK_NL "> "));
-    // Translate bytes into char to be able to send them as an hex string
-    char char_command[2];
-    for (int i=0; i<len; i++) {
-      memset(&char_command, 0, sizeof(char_command));
-      sprintf(&char_command[0], "%02X", reinterpret_cast<const uint8_t*>(buff)[i]);
-      stream.write(char_command, sizeof(char_command));
-    }
+    if (waitResponse(10000L, GF(ACK_NL "> ")) != 1) { return 0; }
+#if defined SIMPLE_NB_SEQUANS_HEX_SEND
+    SimpleNBWriteHex(stream, buff, len);
+#else
+    stream.write(reinterpret_cast<const uint8_t*>(buff), len);
+#endif
     stream.flush();
     if (waitResponse() != 1) {
       DBG("### no OK after send");
@@ -557,7 +572,7 @@ class SimpleNBSequansMonarch :
         SIMPLE_NB_YIELD();
       }
       char c = stream.read();
-      sockets[mux % SIMPLE_NB_MUX_COUNT]->rx.put(c);
+      sockets[mux % SIMPLE_NB_MUX_COUNT]->put(c);
     }
     // DBG("### READ:", len, "from", mux);
     waitResponse();
@@ -612,6 +627,63 @@ class SimpleNBSequansMonarch :
     return sockets[mux % SIMPLE_NB_MUX_COUNT]->sock_connected;
   }
 
+  // UDP connections are opened towards a single peer, endPacket() (re)opens
+  // the connection whenever the destination changes; the local port is
+  // chosen by the modem
+  bool modemUdpBegin(uint8_t, uint16_t) {
+    return true;
+  }
+
+  size_t modemUdpSend(uint8_t mux, const char* host, uint16_t port,
+                      const uint8_t* buff, size_t len) {
+    GsmUdp* udp = udpSockets[mux % SIMPLE_NB_MUX_COUNT];
+    if (udp->peer_port != port || udp->peer_host != host) {
+      if (udp->peer_port) { modemUdpStop(mux); }
+      // Same socket configuration as for TCP, see modemConnect()
+      sendAT(GF("+SQNSCFG="), mux, GF(",3,300,90,600,50"));
+      waitResponse(5000L);
+#if defined SIMPLE_NB_SEQUANS_HEX_SEND
+      sendAT(GF("+SQNSCFGEXT="), mux, GF(",1,0,0,0,1"));
+#else
+      sendAT(GF("+SQNSCFGEXT="), mux, GF(",1,0,0,0,0"));
+#endif
+      waitResponse(5000L);
+      // AT+SQNSD=<connId>,<txProt>=1 (UDP),<rPort>,<IPaddr>,<closureType>,
+      // <lPort>,<connMode>=1 (command mode)
+      sendAT(GF("+SQNSD="), mux, GF(",1,"), port, GF(",\""), host,
+             GF("\",0,"), udp->local_port, GF(",1"));
+      if (waitResponse(75000L) != 1) { return 0; }
+      udp->peer_host = host;
+      udp->peer_port = port;
+    }
+    return modemSendExt(buff, len, mux);
+  }
+
+  void modemUdpRead(uint8_t mux) {
+    GsmUdp* udp = udpSockets[mux % SIMPLE_NB_MUX_COUNT];
+    if (!udp->peer_port) { return; }
+    IPAddress ip;
+    ip.fromString(udp->peer_host.c_str());
+    // On a UDP socket each AT+SQNSRECV returns at most one datagram
+    for (int i = 0; i < SIMPLE_NB_UDP_MAX_DATAGRAMS; i++) {
+      sendAT(GF("+SQNSRECV="), mux, GF(",1500"));
+      if (waitResponse(GF("+SQNSRECV: ")) != 1) { return; }
+      streamSkipUntil(',');  // Skip mux
+      int16_t len = streamGetIntBefore('\n');
+      if (len > 0) {
+        moveDatagramFromStreamToFifo(mux, len, ip, udp->peer_port);
+      }
+      waitResponse();
+      if (len <= 0) { return; }
+    }
+  }
+
+  void modemUdpStop(uint8_t mux) {
+    sendAT(GF("+SQNSH="), mux);
+    waitResponse();
+    udpSockets[mux % SIMPLE_NB_MUX_COUNT]->peer_port = 0;
+  }
+
   /*
    * Utilities
    */
@@ -663,6 +735,8 @@ class SimpleNBSequansMonarch :
         } else if (r5 && data.endsWith(r5)) {
           index = 5;
           goto finish;
+        } else if (handleRegistrationUrc(data)) {
+          data = "";
         } else if (data.endsWith(GF(ACK_NL "+SQNSRING:"))) {
           int8_t  mux = streamGetIntBefore(',');
           int16_t len = streamGetIntBefore('\n');
@@ -671,6 +745,10 @@ class SimpleNBSequansMonarch :
             sockets[mux % SIMPLE_NB_MUX_COUNT]->got_data       = true;
             sockets[mux % SIMPLE_NB_MUX_COUNT]->sock_available = len;
           }
+          if (mux >= 1 && mux <= SIMPLE_NB_MUX_COUNT &&
+              udpSockets[mux % SIMPLE_NB_MUX_COUNT]) {
+            udpSockets[mux % SIMPLE_NB_MUX_COUNT]->got_data = true;
+          }
           data = "";
           DBG("### URC Data Received:", len, "on", mux);
         } else if (data.endsWith(GF("SQNSH: "))) {
@@ -679,6 +757,10 @@ class SimpleNBSequansMonarch :
               sockets[mux % SIMPLE_NB_MUX_COUNT]) {
             sockets[mux % SIMPLE_NB_MUX_COUNT]->sock_connected = false;
           }
+          if (mux >= 1 && mux <= SIMPLE_NB_MUX_COUNT &&
+              udpSockets[mux % SIMPLE_NB_MUX_COUNT]) {
+            udpSockets[mux % SIMPLE_NB_MUX_COUNT]->peer_port = 0;
+          }
           data = "";
           DBG("### URC Sock Closed: ", mux);
         }
@@ -725,6 +807,7 @@ class SimpleNBSequansMonarch :
 
  protected:
   GsmClientSequansMonarch* sockets[SIMPLE_NB_MUX_COUNT];
+  GsmUdp*                  udpSockets[SIMPLE_NB_MUX_COUNT];
   // ACK_NL (\r\n) is not accepted with SQNSSENDEXT in data mode so use \n
   const char*              gsmNL = "\n";
 };
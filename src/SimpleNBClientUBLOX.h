@@ -24,7 +24,10 @@
 #include "SimpleNBModem.tpp"
 #include "SimpleNBSMS.tpp"
 #include "SimpleNBSSL.tpp"
+#include "SimpleNBDNS.tpp"
 #include "SimpleNBTCP.tpp"
+#include "SimpleNBUDP.tpp"
+#include "SimpleNBUbloxUDP.tpp"
 #include "SimpleNBTime.tpp"
 
 #define ACK_NL "\r\n"
@@ -47,15 +50,20 @@ enum RegStatus {
 
 class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
                      public SimpleNBTCP<SimpleNBUBLOX, SIMPLE_NB_MUX_COUNT>,
+                     public SimpleNBUDP<SimpleNBUBLOX, SIMPLE_NB_MUX_COUNT>,
+                      public SimpleNBUbloxUDP<SimpleNBUBLOX>,
                      public SimpleNBSSL<SimpleNBUBLOX>,
                      public SimpleNBCalling<SimpleNBUBLOX>,
                      public SimpleNBSMS<SimpleNBUBLOX>,
                      public SimpleNBGSMLocation<SimpleNBUBLOX>,
                      public SimpleNBGPS<SimpleNBUBLOX>,
                      public SimpleNBTime<SimpleNBUBLOX>,
-                     public SimpleNBBattery<SimpleNBUBLOX> {
+                     public SimpleNBBattery<SimpleNBUBLOX>,
+                     public SimpleNBDNS<SimpleNBUBLOX> {
   friend class SimpleNBModem<SimpleNBUBLOX>;
   friend class SimpleNBTCP<SimpleNBUBLOX, SIMPLE_NB_MUX_COUNT>;
+  friend class SimpleNBUDP<SimpleNBUBLOX, SIMPLE_NB_MUX_COUNT>;
+  friend class SimpleNBUbloxUDP<SimpleNBUBLOX>;
   friend class SimpleNBSSL<SimpleNBUBLOX>;
   friend class SimpleNBCalling<SimpleNBUBLOX>;
   friend class SimpleNBSMS<SimpleNBUBLOX>;
@@ -63,6 +71,7 @@ class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
   friend class SimpleNBGPS<SimpleNBUBLOX>;
   friend class SimpleNBTime<SimpleNBUBLOX>;
   friend class SimpleNBBattery<SimpleNBUBLOX>;
+  friend class SimpleNBDNS<SimpleNBUBLOX>;
 
   /*
    * Inner Client
@@ -103,6 +112,7 @@ class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
 
       uint8_t oldMux = mux;
       sock_connected = at->modemConnect(host, port, &mux, false, timeout_s);
+      if (!sock_connected) { at->connectFailed(mux); }
       if (mux != oldMux) {
         DBG("WARNING:  Mux number changed from", oldMux, "to", mux);
         at->sockets[oldMux] = NULL;
@@ -114,6 +124,21 @@ class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
     }
     SIMPLE_NB_CLIENT_CONNECT_OVERRIDES
 
+    int connectAsync(const char* host, uint16_t port) override {
+      SIMPLE_NB_YIELD();
+      rx.clear();
+      sock_connected = false;
+      uint8_t oldMux   = mux;
+      bool    accepted = at->modemConnect(host, port, &mux, false, 120,
+                                          true);
+      if (mux != oldMux) {
+        DBG("WARNING:  Mux number changed from", oldMux, "to", mux);
+        at->sockets[oldMux] = NULL;
+      }
+      at->sockets[mux] = this;
+      return connectStarted(accepted, 120);
+    }
+
     void stop(uint32_t maxWaitMs) {
       dumpModemBuffer(maxWaitMs);
       at->sendAT(GF("+USOCL="), mux);
@@ -158,6 +183,21 @@ class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
       return sock_connected;
     }
     SIMPLE_NB_CLIENT_CONNECT_OVERRIDES
+
+    int connectAsync(const char* host, uint16_t port) override {
+      SIMPLE_NB_YIELD();
+      rx.clear();
+      sock_connected = false;
+      uint8_t oldMux   = mux;
+      bool    accepted = at->modemConnect(host, port, &mux, true, 120,
+                                          true);
+      if (mux != oldMux) {
+        DBG("WARNING:  Mux number changed from", oldMux, "to", mux);
+        at->sockets[oldMux] = NULL;
+      }
+      at->sockets[mux] = this;
+      return connectStarted(accepted, 120);
+    }
   };
 
   /*
@@ -166,6 +206,7 @@ class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
  public:
   explicit SimpleNBUBLOX(Stream& stream) : stream(stream) {
     memset(sockets, 0, sizeof(sockets));
+    memset(udpSockets, 0, sizeof(udpSockets));
   }
 
   /*
@@ -182,20 +223,21 @@ class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
     if (waitResponse() != 1) { return false; }
 
 #ifdef SIMPLE_NB_DEBUG
-    sendAT(GF("+CMEE=2"));  // turn on verbose error codes
+    sendATSetting(1000L, GF("+CMEE=2"));  // turn on verbose error codes
 #else
-    sendAT(GF("+CMEE=0"));  // turn off error codes
+    sendATSetting(1000L, GF("+CMEE=0"));  // turn off error codes
 #endif
-    waitResponse();
 
     getModemName();
 
     // Enable automatic time zome update
-    sendAT(GF("+CTZU=1"));
-    waitResponse(10000L);
+    sendATSetting(10000L, GF("+CTZU=1"));
     // Ignore the response, in case the network doesn't support it.
     // if (waitResponse(10000L) != 1) { return false; }
 
+    // Report registration changes, with the serving cell, as they happen
+    enableRegistrationUrc(GF("+CGREG=2"));
+
     SimStatus ret = getSimStatus();
     // if the sim isn't ready and a pin has been provided, try to unlock the sim
     if (ret != SIM_READY && pin != NULL && strlen(pin) > 0) {
@@ -208,6 +250,13 @@ class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
     }
   }
 
+  // Warm start, the settings of the full init were saved with AT&W
+  bool fastStartImpl() {
+    if (!testAT()) { return false; }
+    return checkSettings(GF("+CMEE?;+CTZU?;+CPIN?"),
+                         SIMPLE_NB_CMEE_REPLY, "+CTZU: 1", "+CPIN: READY");
+  }
+
   // only difference in implementation is the warning on the wrong type
   String getModemNameImpl() {
     sendAT(GF("+CGMI"));
@@ -246,7 +295,7 @@ class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
   bool restartImpl(const char* pin = NULL) {
     if (!testAT()) { return false; }
     if (!setPhoneFunctionality(16)) { return false; }
-    delay(3000);  // TODO(?):  Verify delay timing here
+    waitForReset(3000L);  // init() then waits for it to come back
     return init(pin);
   }
 
@@ -320,7 +369,8 @@ class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
  protected:
   bool gprsConnectImpl(const char* apn, const char* user = NULL,
                        const char* pwd = NULL) {
-    // gprsDisconnect();
+    // Nothing to do if PSD profile 0 is still active
+    if (dataState() == 1 || queryDataActive()) { return true; }
 
     sendAT(GF("+CGATT=1"));  // attach to GPRS
     if (waitResponse(360000L) != 1) { return false; }
@@ -384,6 +434,7 @@ class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
       return false;
     }
 
+    setDataActive(true);
     return true;
   }
 
@@ -391,6 +442,7 @@ class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
     sendAT(GF(
         "+UPSDA=0,4"));  // Deactivate the PDP context associated with profile 0
     if (waitResponse(360000L) != 1) { return false; }
+    setDataActive(false);
 
     sendAT(GF("+CGATT=0"));  // detach from GPRS
     if (waitResponse(360000L) != 1) { return false; }
@@ -596,12 +648,30 @@ class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
   // (TOBY-L)
   float getTemperatureImpl() SIMPLE_NB_ATTR_NOT_IMPLEMENTED;
 
+  /*
+   * DNS functions
+   */
+ protected:
+  bool resolveImpl(const char* host, int8_t, String& ip, uint32_t&,
+                   uint32_t timeout_ms) {
+    // AT+UDNSRN=<resolution_type>,<domain_ip_string>
+    // +UDNSRN: <resolved_ip_address>, the TTL is not reported
+    sendAT(GF("+UDNSRN=0,\""), host, '"');
+    if (waitResponse(timeout_ms, GF(ACK_NL "+UDNSRN:")) != 1) { return false; }
+    streamSkipUntil('"');
+    ip = stream.readStringUntil('"');
+    waitResponse();
+    return ip.length() > 0;
+  }
+
   /*
    * Client related functions
    */
  protected:
+  // With async set this returns once the open command is accepted, the
+  // +UUSOCO URC then completes the socket in waitResponse()
   bool modemConnect(const char* host, uint16_t port, uint8_t* mux,
-                    bool ssl = false, int timeout_s = 120) {
+                    bool ssl = false, int timeout_s = 120, bool async = false) {
     uint32_t timeout_ms  = ((uint32_t)timeout_s) * 1000;
     uint32_t startMillis = millis();
 
@@ -629,8 +699,14 @@ class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
     // sendAT(GF("+USOSO="), *mux, GF(",6,2,30000"));
     // waitResponse();
 
-    // connect on the allocated socket
-    sendAT(GF("+USOCO="), *mux, ",\"", host, "\",", port);
+    // connect on the allocated socket, plain TCP goes to the cached address
+    String addr = ssl ? String(host) : connectHost(host, *mux, -1);
+
+    if (async) {
+      sendAT(GF("+USOCO="), *mux, ",\"", addr, "\",", port, ",1");
+      return waitResponse() == 1;
+    }
+    sendAT(GF("+USOCO="), *mux, ",\"", addr, "\",", port);
     int8_t rsp = waitResponse(timeout_ms - (millis() - startMillis));
     return (1 == rsp);
   }
@@ -709,6 +785,15 @@ class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
     return (result != 0);
   }
 
+  // AT+UPSND=<profile_id>,8 tells whether the PSD profile is active
+  bool queryDataActive() {
+    sendAT(GF("+UPSND=0,8"));
+    bool active = waitResponse(GF(",8,1"), GFP(ACK_OK), GFP(ACK_ERROR)) == 1;
+    if (active) { waitResponse(); }
+    setDataActive(active);
+    return active;
+  }
+
   /*
    * Utilities
    */
@@ -760,6 +845,12 @@ class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
         } else if (r5 && data.endsWith(r5)) {
           index = 5;
           goto finish;
+        } else if (handleRegistrationUrc(data)) {
+          data = "";
+        } else if (data.endsWith(GF("+UUPSDD:"))) {
+          // PSD profile deactivated by the network
+          if (streamGetIntBefore('\n') == 0) { setDataActive(false); }
+          data = "";
         } else if (data.endsWith(GF("+UUSORD:"))) {
           int8_t  mux = streamGetIntBefore(',');
           int16_t len = streamGetIntBefore('\n');
@@ -770,13 +861,34 @@ class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
           }
           data = "";
           // DBG("### URC Data Received:", len, "on", mux);
+        } else if (data.endsWith(GF("+UUSORF:"))) {
+          int8_t mux = streamGetIntBefore(',');
+          streamSkipUntil('\n');  // the length is taken from +USORF
+          if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && udpSockets[mux]) {
+            udpSockets[mux]->got_data = true;
+          }
+          data = "";
+          DBG("### URC Datagram Received on", mux);
         } else if (data.endsWith(GF("+UUSOCL:"))) {
           int8_t mux = streamGetIntBefore('\n');
           if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && sockets[mux]) {
             sockets[mux]->sock_connected = false;
           }
+          if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && udpSockets[mux]) {
+            udpSockets[mux]->sock_open = false;
+          }
           data = "";
           DBG("### URC Sock Closed: ", mux);
+        } else if (data.endsWith(GF("+UUSOCO:"))) {
+          int8_t mux          = streamGetIntBefore(',');
+          int8_t socket_error = streamGetIntBefore('\n');
+          if (mux >= 0 && mux < SIMPLE_NB_MUX_COUNT && sockets[mux] &&
+              sockets[mux]->sock_opening) {
+            if (0 != socket_error) { connectFailed(mux); }
+            sockets[mux]->connectDone(0 == socket_error);
+          }
+          data = "";
+          DBG("### URC Sock Opened: ", mux, socket_error);
         }
       }
     } while (millis() - startMillis < timeout_ms);
@@ -821,6 +933,7 @@ class SimpleNBUBLOX : public SimpleNBModem<SimpleNBUBLOX>,
 
  protected:
   GsmClientUBLOX* sockets[SIMPLE_NB_MUX_COUNT];
+  GsmUdp*        udpSockets[SIMPLE_NB_MUX_COUNT];
   const char*     gsmNL = ACK_NL;
 };
 
@@ -369,12 +369,17 @@ class SimpleNBXBee : public SimpleNBModem<SimpleNBXBee>,
     return ret_val;
   }
 
+  // initImpl() already writes any changed setting to flash
+  bool saveSettingsImpl() {
+    return true;
+  }
+
   String getModemNameImpl() {
     return getBeeName();
   }
 
-  void setBaudImpl(uint32_t baud) {
-    XBEE_COMMAND_START_DECORATOR(5, )
+  bool setBaudImpl(uint32_t baud) {
+    XBEE_COMMAND_START_DECORATOR(5, false)
     bool changesMade = false;
     switch (baud) {
       case 2400: changesMade |= changeSettingIfNeeded(GF("BD"), 0x1); break;
@@ -396,6 +401,17 @@ class SimpleNBXBee : public SimpleNBModem<SimpleNBXBee>,
     }
     if (changesMade) { writeChanges(); }
     XBEE_COMMAND_END_DECORATOR
+    return true;
+  }
+
+  // DIO7 as CTS and DIO6 as RTS
+  bool setFlowControlImpl(bool enable) {
+    XBEE_COMMAND_START_DECORATOR(5, false)
+    bool changesMade = changeSettingIfNeeded(GF("D7"), enable ? 0x1 : 0x0);
+    changesMade |= changeSettingIfNeeded(GF("D6"), enable ? 0x1 : 0x0);
+    if (changesMade) { writeChanges(); }
+    XBEE_COMMAND_END_DECORATOR
+    return true;
   }
 
   bool testATImpl(uint32_t timeout_ms = 10000L) {
@@ -90,23 +90,149 @@ const T& SimpleNBMax(const T& a, const T& b) {
   return (b < a) ? a : b;
 }
 
+// Writes a buffer to the stream as upper case hex, two characters per byte.
+// Digits come from a lookup table and go out in blocks rather than byte by
+// byte, which matters for modems that only take payloads as hex strings.
+template <class T>
+void SimpleNBWriteHex(T& stream, const void* buff, size_t len) {
+  static const char hexDigits[] = "0123456789ABCDEF";
+  const uint8_t*    p           = reinterpret_cast<const uint8_t*>(buff);
+  char              block[32];
+  size_t            n = 0;
+  for (size_t i = 0; i < len; i++) {
+    block[n++] = hexDigits[p[i] >> 4];
+    block[n++] = hexDigits[p[i] & 0x0F];
+    if (n == sizeof(block)) {
+      stream.write(reinterpret_cast<const uint8_t*>(block), n);
+      n = 0;
+    }
+  }
+  if (n) { stream.write(reinterpret_cast<const uint8_t*>(block), n); }
+}
+
+// Nibble values of hex digits, indexed by the low five bits of the character.
+// '0'-'9' land on 0x10-0x19 and both 'A'-'F' and 'a'-'f' on 0x01-0x06, so
+// the table stays small and decoding is case insensitive.
+static const uint8_t SimpleNBHexNibbles[32] = {
+    0, 10, 11, 12, 13, 14, 15, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 1,  2,  3,  4,  5,  6,  7, 8, 9, 0, 0, 0, 0, 0, 0};
+
+inline uint8_t SimpleNBHexByte(char hi, char lo) {
+  return (SimpleNBHexNibbles[hi & 0x1F] << 4) | SimpleNBHexNibbles[lo & 0x1F];
+}
+
+// Decodes hexLen characters of hex into out, returns the number of bytes.
+// An odd trailing character is ignored.
+inline size_t SimpleNBDecodeHex(const char* hex, size_t hexLen, uint8_t* out) {
+  size_t n = hexLen / 2;
+  for (size_t i = 0; i < n; i++) {
+    out[i] = SimpleNBHexByte(hex[2 * i], hex[2 * i + 1]);
+  }
+  return n;
+}
+
+// Reads hexLen characters of hex from the stream and puts the decoded bytes
+// straight into the FIFO, a block at a time. With a NULL FIFO the data is
+// read and dropped. Returns the number of bytes that did not fit (or were
+// dropped), the wait for more characters is reset whenever some arrive.
+template <class S, class F>
+size_t SimpleNBReadHexToFifo(S& stream, F* fifo, size_t hexLen,
+                             uint32_t timeout_ms) {
+  char     block[32];
+  uint8_t  bytes[sizeof(block) / 2];
+  size_t   dropped     = 0;
+  uint32_t startMillis = millis();
+  while (hexLen >= 2 && millis() - startMillis < timeout_ms) {
+    int avail = stream.available();
+    if (avail < 2) {
+      SIMPLE_NB_YIELD();
+      continue;
+    }
+    size_t n = SimpleNBMin((size_t)avail, hexLen);
+    n        = SimpleNBMin(n, sizeof(block)) & ~(size_t)1;
+    // Everything asked for is already buffered, so skip readBytes() and its
+    // per character timeout handling
+    for (size_t i = 0; i < n; i++) { block[i] = stream.read(); }
+    hexLen -= n;
+    size_t len = SimpleNBDecodeHex(block, n, bytes);
+    size_t put = fifo ? fifo->put(bytes, len) : 0;
+    dropped += len - put;
+    startMillis = millis();
+  }
+  return dropped + hexLen / 2;
+}
+
+// Collects up to max integers from a line, whatever separates them, so
+// "21/10/08,06:27:25" and "2021,10,8,6,27,25" read the same. A sign right in
+// front of a number is kept. Returns the number of integers found.
+inline uint8_t SimpleNBParseInts(const String& line, int* out, uint8_t max) {
+  uint8_t n = 0;
+  for (unsigned i = 0; i < line.length() && n < max; i++) {
+    char c = line[i];
+    if (c < '0' || c > '9') { continue; }
+    bool neg = i > 0 && line[i - 1] == '-';
+    int  v   = 0;
+    for (; i < line.length() && line[i] >= '0' && line[i] <= '9'; i++) {
+      v = v * 10 + (line[i] - '0');
+    }
+    out[n++] = neg ? -v : v;
+  }
+  return n;
+}
+
+// How long an AT probe waits for the OK, long enough for 2400 baud
+#if !defined(SIMPLE_NB_PROBE_TIMEOUT)
+#define SIMPLE_NB_PROBE_TIMEOUT 100
+#endif
+
+// Sends a bare AT and returns as soon as the OK comes back
+template <class T>
+bool SimpleNBProbeAT(T& SerialAT, uint32_t timeout_ms = SIMPLE_NB_PROBE_TIMEOUT) {
+  while (SerialAT.available()) { SerialAT.read(); }  // Drop any garbage
+  SerialAT.print("AT\r\n");
+  uint32_t startMillis = millis();
+  int      prev        = -1;
+  while (millis() - startMillis < timeout_ms) {
+    if (!SerialAT.available()) {
+      SIMPLE_NB_YIELD();
+      continue;
+    }
+    int c = SerialAT.read();
+    if (prev == 'O' && c == 'K') { return true; }
+    prev = c;
+  }
+  return false;
+}
+
+// Finds the modem's baud rate. A rate saved from an earlier run can be given
+// as lastKnown and is tried first, the others follow from the most common.
 template <class T>
 uint32_t SimpleNBAutoBaud(T& SerialAT, uint32_t minimum = 9600,
-                         uint32_t maximum = 115200) {
-  static uint32_t rates[] = {115200, 57600,  38400, 19200, 9600,  74400, 74880,
-                             230400, 460800, 2400,  4800,  14400, 28800};
-
-  for (uint8_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
-    uint32_t rate = rates[i];
-    if (rate < minimum || rate > maximum) continue;
-
-    DBG("Trying baud rate", rate, "...");
-    SerialAT.begin(rate);
-    delay(10);
-    for (int j = 0; j < 10; j++) {
-      SerialAT.print("AT\r\n");
-      String input = SerialAT.readString();
-      if (input.indexOf("OK") >= 0) {
+                          uint32_t maximum = 115200, uint32_t lastKnown = 0) {
+  static uint32_t rates[] = {115200, 9600,  57600, 38400, 19200, 230400, 460800,
+                             921600, 74880, 74400, 14400, 28800, 4800,   2400};
+
+  if (lastKnown) {
+    SerialAT.begin(lastKnown);
+    for (int j = 0; j < 3; j++) {
+      if (SimpleNBProbeAT(SerialAT)) {
+        DBG("Modem responded at last known rate", lastKnown);
+        return lastKnown;
+      }
+    }
+  }
+
+  // Go round all the rates a few times rather than dwelling on each, a
+  // modem that is still booting gets time to come up
+  for (int j = 0; j < 3; j++) {
+    for (uint8_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+      uint32_t rate = rates[i];
+      if (rate < minimum || rate > maximum || rate == lastKnown) continue;
+
+      DBG("Trying baud rate", rate, "...");
+      SerialAT.begin(rate);
+      // The first AT may only be used by the modem to detect the rate
+      if (SimpleNBProbeAT(SerialAT) || SimpleNBProbeAT(SerialAT)) {
         DBG("Modem responded at rate", rate);
         return rate;
       }
@@ -116,18 +242,14 @@ uint32_t SimpleNBAutoBaud(T& SerialAT, uint32_t minimum = 9600,
   return 0;
 }
 
+// Opens the modem's serial port at a known rate and waits up to timeout_ms
+// for the modem to answer
 template <class T>
-bool SimpleNBBegin(T& SerialAT, uint32_t rate) {
+bool SimpleNBBegin(T& SerialAT, uint32_t rate, uint32_t timeout_ms = 10000L) {
   DBG("Communicate at baud rate", rate, "...");
   SerialAT.begin(rate);
-  delay(10);
-  for (int j = 0; j < 10; j++) {
-    SerialAT.print("AT\r\n");
-    String input = SerialAT.readString();
-    if (input.indexOf("OK") >= 0) {
-      return true;
-    }
-    delay(10);
+  for (uint32_t start = millis(); millis() - start < timeout_ms;) {
+    if (SimpleNBProbeAT(SerialAT)) { return true; }
   }
   DBG("No response from modem, check your hardware connection");
   return false;
@@ -0,0 +1,94 @@
+/**
+ * @file       SimpleNBContexts.tpp
+ * @author     Henry Cheung
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2021 Henry Cheung
+ * @date       Oct 2021
+ */
+
+#ifndef SRC_SIMPLE_NB_CONTEXTS_H_
+#define SRC_SIMPLE_NB_CONTEXTS_H_
+
+#include "SimpleNBCommon.h"
+
+#define SIMPLE_NB_SUPPORT_CONTEXTS
+
+// The modem implements:
+//   bool defineContextImpl(uint8_t cid, const char* apn, const char* user,
+//                          const char* pwd);
+//   bool activateContextImpl(uint8_t cid);
+//   bool deactivateContextImpl(uint8_t cid);
+//   bool queryContextImpl(uint8_t cid, String& ip);  // true if active
+// calls setContextState() when a context comes up or goes down, and opens a
+// socket on the context its client was bound to with setContext().
+
+template <class modemType>
+class SimpleNBContexts {
+ public:
+  /*
+   * Data context functions
+   */
+  // Sets the APN of a data context, so several APNs can be active at once;
+  // the context ids are the modem's own (0-3 on SIM70x0, 1-16 on BG96)
+  bool setContextApn(uint8_t cid, const char* apn, const char* user = NULL,
+                     const char* pwd = NULL) {
+    return thisModem().defineContextImpl(cid, apn, user, pwd);
+  }
+  // Brings a context up, nothing is sent if it is known to be up already
+  bool activateContext(uint8_t cid) {
+    if (isContextActive(cid)) { return true; }
+    return thisModem().activateContextImpl(cid);
+  }
+  bool deactivateContext(uint8_t cid) {
+    return thisModem().deactivateContextImpl(cid);
+  }
+  // Answered from the state kept from the modem's URCs while the context is
+  // known to be up, otherwise asks the modem
+  bool isContextActive(uint8_t cid) {
+    if (thisModem().net.contexts & contextBit(cid)) {
+      thisModem().streamClear();  // a deactivation may be waiting
+      if (thisModem().net.contexts & contextBit(cid)) { return true; }
+    }
+    String ip;
+    return thisModem().queryContextImpl(cid, ip);
+  }
+  // Address the network assigned to the context, empty if it is down
+  String getContextIP(uint8_t cid) {
+    String ip;
+    if (!thisModem().queryContextImpl(cid, ip)) { return ""; }
+    return ip;
+  }
+
+  /*
+   * CRTP Helper
+   */
+ protected:
+  inline const modemType& thisModem() const {
+    return static_cast<const modemType&>(*this);
+  }
+  inline modemType& thisModem() {
+    return static_cast<modemType&>(*this);
+  }
+
+  /*
+   * Utilities
+   */
+ protected:
+  void setContextState(uint8_t cid, bool active) {
+    uint16_t& contexts = thisModem().net.contexts;
+    if (((contexts & contextBit(cid)) != 0) != active) {
+      DBG("### Context", cid, active ? "up" : "down");
+    }
+    if (active) {
+      contexts |= contextBit(cid);
+    } else {
+      contexts &= ~contextBit(cid);
+    }
+  }
+
+  static uint16_t contextBit(uint8_t cid) {
+    return (uint16_t)1 << (cid & 0x0F);
+  }
+};
+
+#endif  // SRC_SIMPLE_NB_CONTEXTS_H_
@@ -0,0 +1,185 @@
+/**
+ * @file       SimpleNBDNS.tpp
+ * @author     Henry Cheung
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2021 Henry Cheung
+ * @date       Oct 2021
+ */
+
+#ifndef SRC_SIMPLE_NB_DNS_H_
+#define SRC_SIMPLE_NB_DNS_H_
+
+#include "SimpleNBCommon.h"
+
+#define SIMPLE_NB_SUPPORT_DNS
+
+// Number of host names remembered by resolve()
+#if !defined(SIMPLE_NB_DNS_CACHE_SIZE)
+#define SIMPLE_NB_DNS_CACHE_SIZE 4
+#endif
+
+// Seconds an answer is reused when the modem doesn't report the record's TTL
+#if !defined(SIMPLE_NB_DNS_TTL)
+#define SIMPLE_NB_DNS_TTL 300
+#endif
+
+// The modem implements:
+//   bool resolveImpl(const char* host, int8_t cid, String& ip,
+//                    uint32_t& ttl_s, uint32_t timeout_ms);
+// looking the name up on data context cid (-1 for the modem's default) where
+// it can, and leaving ttl_s untouched unless the modem reports it.
+// Answers are cached per context, as each may reach a different network.
+
+template <class modemType>
+class SimpleNBDNS {
+ public:
+  /*
+   * DNS functions
+   */
+  // Resolves a host name to a dotted IP address on data context cid, see
+  // activateContext(), answers are cached until their TTL runs out. Returns
+  // an empty string if the name can't be resolved.
+  String resolve(const char* host, uint32_t timeout_ms = 15000L,
+                 int8_t cid = -1) {
+    if (isIpAddress(host)) { return host; }
+
+    DnsEntry* entry = findDnsEntry(host, cid);
+    if (entry) {
+      dns_hits++;
+      entry->last_used = millis();
+      return entry->ip;
+    }
+
+    dns_misses++;
+    String   ip;
+    uint32_t ttl_s = SIMPLE_NB_DNS_TTL;
+    if (!thisModem().resolveImpl(host, cid, ip, ttl_s, timeout_ms)) {
+      DBG("### DNS lookup failed:", host);
+      return "";
+    }
+    storeDnsEntry(host, cid, ip, ttl_s);
+    return ip;
+  }
+
+  uint16_t getDnsCacheHits() {
+    return dns_hits;
+  }
+
+  uint16_t getDnsCacheMisses() {
+    return dns_misses;
+  }
+
+  // Share of the lookups answered from the cache, in percent
+  uint8_t getDnsCacheHitRate() {
+    uint32_t total = (uint32_t)dns_hits + dns_misses;
+    if (!total) { return 0; }
+    return (uint32_t)dns_hits * 100 / total;
+  }
+
+  void clearDnsCache() {
+    for (uint8_t i = 0; i < SIMPLE_NB_DNS_CACHE_SIZE; i++) {
+      dns_cache[i].host = "";
+    }
+  }
+
+  /*
+   * CRTP Helper
+   */
+ protected:
+  inline const modemType& thisModem() const {
+    return static_cast<const modemType&>(*this);
+  }
+  inline modemType& thisModem() {
+    return static_cast<modemType&>(*this);
+  }
+
+  /*
+   * Utilities
+   */
+ protected:
+  // Host to hand to the modem's open command on socket mux over context cid,
+  // so the modem doesn't resolve the name again on every connect. If the
+  // lookup fails the name is passed on and the modem gets its own try.
+  String connectHost(const char* host, uint8_t mux, int8_t cid) {
+    String    ip    = resolve(host, 15000L, cid);
+    DnsEntry* entry = ip.length() ? findDnsEntry(host, cid) : NULL;
+    dns_socket[mux % SIMPLE_NB_MUX_COUNT] = entry ? entry - dns_cache + 1 : 0;
+    return ip.length() ? ip : String(host);
+  }
+
+  // The open on socket mux failed, the cached address it was given may be
+  // stale so the next connect looks the name up again
+  void connectFailed(uint8_t mux) {
+    uint8_t& slot = dns_socket[mux % SIMPLE_NB_MUX_COUNT];
+    if (slot) { dns_cache[slot - 1].host = ""; }
+    slot = 0;
+  }
+
+  // Drops the name's address on every context
+  void dropDnsEntry(const char* host) {
+    for (uint8_t i = 0; i < SIMPLE_NB_DNS_CACHE_SIZE; i++) {
+      if (dns_cache[i].host == host) { dns_cache[i].host = ""; }
+    }
+  }
+
+  static bool isIpAddress(const char* host) {
+    for (const char* c = host; *c; c++) {
+      if (*c != '.' && (*c < '0' || *c > '9')) { return false; }
+    }
+    return true;
+  }
+
+  struct DnsEntry {
+    String   host;
+    int8_t   cid;
+    String   ip;
+    uint32_t stored;
+    uint32_t ttl_ms;
+    uint32_t last_used;
+  };
+
+  DnsEntry* findDnsEntry(const char* host, int8_t cid) {
+    for (uint8_t i = 0; i < SIMPLE_NB_DNS_CACHE_SIZE; i++) {
+      DnsEntry& entry = dns_cache[i];
+      if (!entry.host.length() || entry.host != host || entry.cid != cid) {
+        continue;
+      }
+      if (millis() - entry.stored >= entry.ttl_ms) {
+        entry.host = "";  // expired
+        return NULL;
+      }
+      return &entry;
+    }
+    return NULL;
+  }
+
+  // Takes a free slot, otherwise the least recently used one
+  void storeDnsEntry(const char* host, int8_t cid, const String& ip,
+                     uint32_t ttl_s) {
+    DnsEntry* slot = &dns_cache[0];
+    for (uint8_t i = 0; i < SIMPLE_NB_DNS_CACHE_SIZE; i++) {
+      DnsEntry& entry = dns_cache[i];
+      if (!entry.host.length()) {
+        slot = &entry;
+        break;
+      }
+      if (millis() - entry.last_used > millis() - slot->last_used) {
+        slot = &entry;
+      }
+    }
+    slot->host      = host;
+    slot->cid       = cid;
+    slot->ip        = ip;
+    slot->stored    = millis();
+    slot->ttl_ms    = SimpleNBMin(ttl_s, (uint32_t)86400) * 1000;
+    slot->last_used = slot->stored;
+  }
+
+  DnsEntry dns_cache[SIMPLE_NB_DNS_CACHE_SIZE];
+  // Cache slot + 1 of the address each socket was last opened to, 0 for none
+  uint8_t  dns_socket[SIMPLE_NB_MUX_COUNT] = {};
+  uint16_t dns_hits   = 0;
+  uint16_t dns_misses = 0;
+};
+
+#endif  // SRC_SIMPLE_NB_DNS_H_
@@ -0,0 +1,244 @@
+/**
+ * @file       SimpleNBHttp.tpp
+ * @author     Henry Cheung
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2021 Henry Cheung
+ * @date       Oct 2021
+ */
+
+#ifndef SRC_SIMPLE_NB_HTTP_H_
+#define SRC_SIMPLE_NB_HTTP_H_
+
+#include "SimpleNBCommon.h"
+
+#define SIMPLE_NB_SUPPORT_HTTP
+
+// Number of request headers httpAddHeader() keeps for the next request
+#if !defined(SIMPLE_NB_HTTP_MAX_HEADERS)
+#define SIMPLE_NB_HTTP_MAX_HEADERS 4
+#endif
+
+// How long a request may take until the status line is in, in ms
+#if !defined(SIMPLE_NB_HTTP_TIMEOUT)
+#define SIMPLE_NB_HTTP_TIMEOUT 60000L
+#endif
+
+enum HttpMethod {
+  HTTP_METHOD_GET    = 0,
+  HTTP_METHOD_POST   = 1,
+  HTTP_METHOD_PUT    = 2,
+  HTTP_METHOD_DELETE = 3,
+};
+
+// The request runs on the modem's own HTTP stack, only the request and the
+// body cross the UART. The modem implements:
+//   bool httpConnectImpl();  // towards http_host, http_port and http_ssl
+//   int  httpSendImpl(HttpMethod method, const String& path,
+//                     const uint8_t* body, size_t len,
+//                     const char* content_type);  // status, -1 on failure
+//   int  httpReadImpl(uint8_t* buf, size_t size);  // next body bytes, -1 if
+//                                                  // some were lost
+//   void httpCloseImpl();
+// sending the http_headers along and setting http_length, and
+// http_response_headers where the modem reports them. An https server is
+// checked against http_ca, or not at all if that is empty, which
+// httpRequest() only lets through with http_insecure set.
+
+template <class modemType>
+class SimpleNBHttp {
+ public:
+  /*
+   * HTTP functions
+   */
+  // Adds a header to the next request
+  bool httpAddHeader(const char* name, const char* value) {
+    if (http_header_count >= SIMPLE_NB_HTTP_MAX_HEADERS) { return false; }
+    http_headers[http_header_count][0] = name;
+    http_headers[http_header_count][1] = value;
+    http_header_count++;
+    return true;
+  }
+
+  // CA certificate https servers are checked against, in the form the
+  // modem's setCertificate() takes
+  void httpSetCertificate(const String& certificate) {
+    httpEnd();
+    http_ca = certificate;
+  }
+  // Lets https requests go out without a certificate, so without checking
+  // who the server is
+  void httpSetInsecure(bool insecure = true) {
+    httpEnd();
+    http_insecure = insecure;
+  }
+
+  int httpGet(const char* url) {
+    return httpRequest(HTTP_METHOD_GET, url);
+  }
+  int httpPost(const char* url, const uint8_t* body, size_t len,
+               const char* content_type = "application/octet-stream") {
+    return httpRequest(HTTP_METHOD_POST, url, body, len, content_type);
+  }
+  int httpPost(const char* url, const char* body,
+               const char* content_type = "text/plain") {
+    return httpRequest(HTTP_METHOD_POST, url, (const uint8_t*)body,
+                       strlen(body), content_type);
+  }
+
+  // Sends a request to an http:// or https:// url and returns the status
+  // code, -1 if no response came or an https url was given with neither
+  // httpSetCertificate() nor httpSetInsecure(). The connection stays open
+  // for the next request to the same server until httpEnd().
+  int httpRequest(HttpMethod method, const char* url,
+                  const uint8_t* body = NULL, size_t len = 0,
+                  const char* content_type = NULL) {
+    String   host, path;
+    uint16_t port;
+    bool     ssl;
+    http_status = -1;
+    http_length = -1;
+    http_read   = 0;
+    http_response_headers = "";
+    if (!parseUrl(url, ssl, host, port, path) ||
+        (ssl && !http_ca.length() && !http_insecure)) {
+      http_header_count = 0;
+      return -1;
+    }
+    if (http_open && (host != http_host || port != http_port || ssl != http_ssl)) {
+      httpEnd();
+    }
+    if (!http_open) {
+      http_host = host;
+      http_port = port;
+      http_ssl  = ssl;
+      http_open = thisModem().httpConnectImpl();
+    }
+    int status = -1;
+    if (http_open) {
+      status = thisModem().httpSendImpl(method, path, body, len, content_type);
+    }
+    http_header_count = 0;
+    // A broken connection is opened again by the next request
+    if (status < 0) { httpEnd(); }
+    http_status = status;
+    return status;
+  }
+
+  // Length of the response body, -1 if the server didn't tell
+  int32_t httpContentLength() {
+    return http_length;
+  }
+
+  // Reads the next part of the response body, as much as fits buf at once,
+  // returns 0 once it is all read and -1 if part of it was lost, e.g. a body
+  // larger than the modem driver can hold
+  int httpRead(uint8_t* buf, size_t size) {
+    if (http_status < 0) { return 0; }
+    if (http_length >= 0) {
+      size = SimpleNBMin(size, (size_t)(http_length - http_read));
+    }
+    if (!size) { return 0; }
+    int n = thisModem().httpReadImpl(buf, size);
+    if (n < 0) { return -1; }
+    if (n == 0) { return 0; }
+    http_read += n;
+    return n;
+  }
+
+  // Reads the rest of the response body into a String, empty if part of it
+  // was lost
+  String httpReadString() {
+    String  res;
+    uint8_t buf[256];
+    int     n;
+    if (http_length > 0) { res.reserve(http_length - http_read); }
+    while ((n = httpRead(buf, sizeof(buf))) > 0) {
+      for (int i = 0; i < n; i++) { res += (char)buf[i]; }
+    }
+    if (n < 0) { return ""; }
+    return res;
+  }
+
+  // Value of a response header, empty if it wasn't sent or the modem
+  // doesn't report the headers
+  String httpHeader(const char* name) {
+    String key = String(name) + ':';
+    int    from = 0;
+    while (from < (int)http_response_headers.length()) {
+      int end = http_response_headers.indexOf('\n', from);
+      if (end < 0) { end = http_response_headers.length(); }
+      String line = http_response_headers.substring(from, end);
+      from        = end + 1;
+      if (line.length() > key.length() &&
+          line.substring(0, key.length()).equalsIgnoreCase(key)) {
+        line.remove(0, key.length());
+        line.trim();
+        return line;
+      }
+    }
+    return "";
+  }
+
+  // Closes the connection to the server
+  void httpEnd() {
+    if (http_open) { thisModem().httpCloseImpl(); }
+    http_open = false;
+  }
+
+  /*
+   * CRTP Helper
+   */
+ protected:
+  inline const modemType& thisModem() const {
+    return static_cast<const modemType&>(*this);
+  }
+  inline modemType& thisModem() {
+    return static_cast<modemType&>(*this);
+  }
+
+  /*
+   * Utilities
+   */
+ protected:
+  // [http[s]://]host[:port][/path], the port defaults to the scheme's
+  static bool parseUrl(const char* url, bool& ssl, String& host,
+                       uint16_t& port, String& path) {
+    String u = url;
+    ssl      = u.startsWith("https://");
+    if (u.indexOf("://") >= 0) { u.remove(0, u.indexOf("://") + 3); }
+    int slash = u.indexOf('/');
+    path      = slash < 0 ? String("/") : u.substring(slash);
+    host      = slash < 0 ? u : u.substring(0, slash);
+    int colon = host.indexOf(':');
+    port      = ssl ? 443 : 80;
+    if (colon >= 0) {
+      port = host.substring(colon + 1).toInt();
+      host.remove(colon);
+    }
+    return host.length() > 0 && port != 0;
+  }
+
+  // The request headers as sent on the wire
+  String httpHeaderLines() {
+    String lines;
+    for (uint8_t i = 0; i < http_header_count; i++) {
+      lines += http_headers[i][0] + ": " + http_headers[i][1] + "\r\n";
+    }
+    return lines;
+  }
+
+  String   http_host;
+  uint16_t http_port = 0;
+  bool     http_ssl  = false;
+  bool     http_open = false;
+  String   http_ca;
+  bool     http_insecure = false;
+  String   http_headers[SIMPLE_NB_HTTP_MAX_HEADERS][2];
+  uint8_t  http_header_count = 0;
+  int      http_status       = -1;
+  int32_t  http_length       = -1;
+  int32_t  http_read         = 0;
+  String   http_response_headers;
+};
+
+#endif  // SRC_SIMPLE_NB_HTTP_H_
@@ -13,6 +13,91 @@
 
 #include "SimpleNBCommon.h"
 
+// Number of configuration commands remembered by sendATSetting()
+#if !defined(SIMPLE_NB_SETTINGS_SHADOW)
+#define SIMPLE_NB_SETTINGS_SHADOW 12
+#endif
+
+// Free bytes left in a receive FIFO below which the host is asked to drop RTS
+#if !defined(SIMPLE_NB_RTS_LOW_WATER)
+#define SIMPLE_NB_RTS_LOW_WATER 16
+#endif
+
+// Milliseconds without a command after which sleepIfIdle() lets the modem
+// sleep, and how long a wake may take before sendAT() goes ahead anyway
+#if !defined(SIMPLE_NB_SLEEP_IDLE)
+#define SIMPLE_NB_SLEEP_IDLE 5000L
+#endif
+#if !defined(SIMPLE_NB_WAKE_TIMEOUT)
+#define SIMPLE_NB_WAKE_TIMEOUT 1000L
+#endif
+
+// Reply to AT+CMEE? once init() has set the error reporting
+#if defined(SIMPLE_NB_DEBUG)
+#define SIMPLE_NB_CMEE_REPLY "+CMEE: 2"
+#else
+#define SIMPLE_NB_CMEE_REPLY "+CMEE: 0"
+#endif
+
+// What the network told the modem, kept from the URCs as they come in
+struct NetworkState {
+  // Registration for CREG, CGREG and CEREG, -1 if not reported
+  int8_t   registration[3] = {-1, -1, -1};
+  uint16_t tac             = 0;  // tracking or location area code
+  uint32_t cell            = 0;
+  // Operator as named by the network, empty if not reported
+  String   operator_name;
+  uint16_t mcc = 0;
+  uint16_t mnc = 0;
+  // Network time in UTC with the time zone in quarter hours, time_at is the
+  // millis() when it was reported
+  bool     has_time = false;
+  uint32_t time_at  = 0;
+  uint16_t year     = 0;
+  uint8_t  month    = 0;
+  uint8_t  day      = 0;
+  uint8_t  hour     = 0;
+  uint8_t  minute   = 0;
+  uint8_t  second   = 0;
+  int8_t   timezone = 0;
+  int8_t   dst      = -1;
+  // Power saving mode, psm_at is the millis() of the last change. The
+  // timers the network granted are kept as sent, 0xFF if not reported.
+  bool     psm        = false;
+  uint32_t psm_at     = 0;
+  uint8_t  psm_tau    = 0xFF;
+  uint8_t  psm_active = 0xFF;
+  // Radio connection from +CSCON, 1 connected, 0 idle, -1 not reported
+  int8_t   rrc        = -1;
+  // Data context, 1 active, 0 down, -1 not known; kept on modems that
+  // report its deactivation
+  int8_t   data       = -1;
+  // Data contexts known to be active, bit n for context n; kept on modems
+  // with SIMPLE_NB_SUPPORT_CONTEXTS
+  uint16_t contexts   = 0;
+};
+
+enum InitMode {
+  INIT_FULL       = 0,
+  INIT_FAST_START = 1,
+};
+
+// The codes match the BG96 scan sequence
+enum RadioTech {
+  RADIO_NONE  = 0,
+  RADIO_GSM   = 1,
+  RADIO_CATM  = 2,
+  RADIO_NBIOT = 3,
+};
+
+// Release assistance, tells the network whether it may drop the radio
+// connection right after a send instead of waiting for its inactivity timer
+enum ReleaseAssist {
+  RAI_NONE        = 0,  // more data may follow
+  RAI_LAST_PACKET = 1,  // no further uplink or downlink expected
+  RAI_AFTER_REPLY = 2,  // only a single downlink reply expected
+};
+
 enum SimStatus {
   SIM_ERROR            = 0,
   SIM_READY            = 1,
@@ -27,19 +112,113 @@ class SimpleNBModem {
    * Basic functions
    */
   bool begin(const char* pin = NULL) {
+    clearSettingsShadow();
     return thisModem().initImpl(pin);
   }
   bool init(const char* pin = NULL) {
     return thisModem().initImpl(pin);
   }
+  // INIT_FAST_START confirms with a single query that the settings saved by
+  // an earlier init survived the power cycle and skips setting them again.
+  // If they didn't, the full init runs and saves them for the next boot.
+  bool init(InitMode mode, const char* pin = NULL) {
+    uint32_t startMillis = millis();
+    bool     fast = mode == INIT_FAST_START && thisModem().fastStartImpl();
+    bool     ok   = fast || thisModem().initImpl(pin);
+    if (ok && mode == INIT_FAST_START && !fast) {
+      thisModem().saveSettingsImpl();
+    }
+    init_time = millis() - startMillis;
+    init_fast = fast;
+    DBG("### Ready in", init_time, "ms", fast ? "(fast start)" : "");
+    return ok;
+  }
+  // How long the last init(InitMode) took until the modem was ready, in ms
+  uint32_t getInitTime() {
+    return init_time;
+  }
+  // Whether the last init(InitMode) could skip the full init
+  bool isFastStart() {
+    return init_fast;
+  }
   template <typename... Args>
   inline void sendAT(Args... cmd) {
+    if (asleep) { wakeFromSleep(); }
+    // The reply has to get through even while a FIFO is full, the next FIFO
+    // update drops RTS again
+    if (!rts_ready) {
+      rts_ready = true;
+      rts_cb(true);
+    }
+    last_command = millis();
     thisModem().streamWrite("AT", cmd..., thisModem().gsmNL);
     thisModem().stream.flush();
     SIMPLE_NB_YIELD(); /* DBG("### AT:", cmd...); */
   }
-  void setBaud(uint32_t baud) {
-    thisModem().setBaudImpl(baud);
+  bool setBaud(uint32_t baud) {
+    return thisModem().setBaudImpl(baud);
+  }
+  // Moves the modem and the host port from the current rate to the fastest
+  // rate up to maxRate on which the modem still answers. Each step is checked
+  // with AT and undone if it fails, persist saves the rate that was kept.
+  // Returns the rate in use, or 0 if the modem was lost on the way.
+  template <class T>
+  uint32_t negotiateMaxBaud(T& SerialAT, uint32_t current,
+                            uint32_t maxRate = 921600, bool persist = false) {
+    static uint32_t rates[] = {921600, 460800, 230400, 115200};
+
+    for (uint8_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+      uint32_t rate = rates[i];
+      if (rate > maxRate || rate <= current) continue;
+
+      DBG("### Trying baud rate", rate);
+      // The OK still comes back at the current rate
+      if (!thisModem().setBaudImpl(rate)) continue;
+      SerialAT.flush();
+      SerialAT.begin(rate);
+      if (thisModem().testATImpl(500L)) {
+        DBG("### Modem switched to", rate);
+        if (persist) { thisModem().saveSettingsImpl(); }
+        return rate;
+      }
+
+      // The modem switched but the line doesn't hold up at this rate, ask
+      // for the old rate blindly and check that we got it back
+      thisModem().setBaudImpl(current);
+      SerialAT.flush();
+      SerialAT.begin(current);
+      if (!thisModem().testATImpl(500L)) {
+        DBG("### Modem lost at", rate, "searching...");
+        return SimpleNBAutoBaud(SerialAT, 9600, maxRate, current);
+      }
+    }
+    return current;
+  }
+  // Called with false when the host should drop RTS and hold the modem back,
+  // and with true once it may send again
+  typedef void (*RtsCallback)(bool ready);
+  // Turns RTS/CTS flow control on the modem's UART on or off. The host port
+  // must do the same, in hardware or through the rts callback, which follows
+  // the fullest receive FIFO and is raised for every AT command. With flow
+  // control on, a read() takes data from the modem straight into its buffer,
+  // up to SIMPLE_NB_RX_CHUNK_FLOW bytes at once.
+  bool setFlowControl(bool enable, RtsCallback rts = NULL) {
+    rts_cb    = enable ? rts : NULL;
+    rts_ready = true;
+    if (rts_cb) { rts_cb(true); }
+    flow_control = thisModem().setFlowControlImpl(enable) && enable;
+    return flow_control == enable;
+  }
+  bool isFlowControlEnabled() {
+    return flow_control;
+  }
+  // Reports the free space of the fullest receive FIFO after one was filled
+  // or read
+  void updateRts(int fifo_free) {
+    bool ready = fifo_free >= SIMPLE_NB_RTS_LOW_WATER;
+    if (!rts_cb || ready == rts_ready) { return; }
+    rts_ready = ready;
+    rts_cb(ready);
   }
   // Test response to AT commands
   bool testAT(uint32_t timeout_ms = 10000L) {
@@ -56,6 +235,13 @@ class SimpleNBModem {
     return thisModem().getModemNameImpl();
   }
   bool factoryDefault() {
+    clearSettingsShadow();
+    flow_control = false;
+    // Let the modem send again before the callback is dropped, sendAT()
+    // would call it otherwise
+    if (!rts_ready) { rts_cb(true); }
+    rts_ready = true;
+    rts_cb    = NULL;
     return thisModem().factoryDefaultImpl();
   }
 
@@ -93,11 +279,16 @@ class SimpleNBModem {
     return thisModem().gprsDisconnectImpl();
   }
   // Checks if current attached to GPRS/EPS service
+  // Answered from the data context state where the modem keeps it
   bool isGprsConnected() {
+    int8_t state = dataState();
+    if (state >= 0) { return state == 1; }
     return thisModem().isGprsConnectedImpl();
   }
-  // Gets the current network operator
+  // Gets the current network operator, the name the network announced if
+  // the modem reported one
   String getOperator() {
+    if (net.operator_name.length()) { return net.operator_name; }
     return thisModem().getOperatorImpl();
   }
 
@@ -105,9 +296,11 @@ class SimpleNBModem {
    * Power functions
    */
   bool restart(const char* pin = NULL) {
+    clearSettingsShadow();
     return thisModem().restartImpl(pin);
   }
   bool powerOff() {
+    clearSettingsShadow();
     return thisModem().powerOffImpl();
   }
   bool radioOff() {
@@ -116,7 +309,47 @@ class SimpleNBModem {
   bool sleepEnable(bool enable = true) {
     return thisModem().sleepEnableImpl(enable);
   }
+  // Drives the modem's DTR pin, the modem may sleep while it is high
+  typedef void (*DtrCallback)(bool high);
+  // Hands DTR to the library. With sleep enabled (sleepEnable()) the modem
+  // sleeps while DTR is high and its UART ignores commands, so sendAT()
+  // pulls DTR low and waits for the modem to answer before every command.
+  // sleepIfIdle(), which maintain() also calls, releases DTR again once
+  // idle_ms passed without a command. NULL leaves DTR to the sketch.
+  void setSleepManager(DtrCallback dtr, uint32_t idle_ms = SIMPLE_NB_SLEEP_IDLE) {
+    if (asleep) { wakeFromSleep(); }
+    dtr_cb       = dtr;
+    sleep_idle   = idle_ms;
+    last_command = millis();
+    if (dtr_cb) { dtr_cb(false); }
+  }
+  // Lets the modem sleep if it had no command for the idle time, returns
+  // true while it sleeps
+  bool sleepIfIdle() {
+    if (!dtr_cb || asleep || millis() - last_command < sleep_idle) {
+      return asleep;
+    }
+    dtr_cb(true);
+    asleep       = true;
+    asleep_since = millis();
+    return true;
+  }
+  bool isAsleep() {
+    return asleep;
+  }
+  // Time spent asleep in ms, including the current sleep
+  uint32_t getSleepTime() {
+    return sleep_total + (asleep ? millis() - asleep_since : 0);
+  }
+  // How long the last wake took until the modem answered, in ms
+  uint32_t getWakeLatency() {
+    return wake_latency;
+  }
+  uint16_t getWakeCount() {
+    return wake_count;
+  }
   bool setPhoneFunctionality(uint8_t fun, bool reset = false) {
+    if (reset) { clearSettingsShadow(); }
     return thisModem().setPhoneFunctionalityImpl(fun, reset);
   }
 
@@ -124,9 +357,41 @@ class SimpleNBModem {
    * Generic network functions
    */
   // RegStatus getRegistrationStatus() {}
+  // Once the modem reports registration changes by URC this only looks at
+  // the state kept from them, no AT command is sent
   bool isNetworkRegistered() {
+    if (reg_urc && registrationKnown()) {
+      thisModem().streamClear();
+      return registrationOk();
+    }
     return thisModem().isNetworkRegisteredImpl();
   }
+  // Tracking (or location) area code and cell id of the serving cell, as
+  // last reported by the modem, 0 if it hasn't reported them
+  uint16_t getTrackingAreaCode() {
+    return net.tac;
+  }
+  uint32_t getCellId() {
+    return net.cell;
+  }
+  // Everything the modem has reported about the network so far, after
+  // handling the URCs that are waiting
+  const NetworkState& getNetworkState() {
+    if (reg_urc) { thisModem().streamClear(); }
+    return net;
+  }
+  // Turns on the +CSCON URC, so getIdleDelay() can tell when the network
+  // released the radio connection
+  bool enableConnectionUrc() {
+    return sendATSetting(1000L, GF("+CSCON=1"));
+  }
+  // Milliseconds from the end of the last socket send until the network
+  // released the radio connection, 0 until a release was seen. Compare it
+  // with and without release assistance on the socket.
+  uint32_t getIdleDelay() {
+    thisModem().streamClear();
+    return idle_delay;
+  }
   // Waits for network attachment
   bool waitForRegistration(uint32_t timeout_ms = 60000L, bool check_signal = false) {
     return thisModem().waitForRegistrationImpl(timeout_ms, check_signal);
@@ -157,20 +422,36 @@ class SimpleNBModem {
    * Basic functions
    */
  protected:
-  void setBaudImpl(uint32_t baud) {
+  bool setBaudImpl(uint32_t baud) {
     thisModem().sendAT(GF("+IPR="), baud);
-    thisModem().waitResponse();
+    return thisModem().waitResponse() == 1;
+  }
+
+  bool setFlowControlImpl(bool enable) {
+    return sendATSetting(1000L, GF("+IFC="), enable ? GF("2,2") : GF("0,0"));
   }
 
+  // A booting modem announces itself with RDY, which ends the pause
+  // between probes early
   bool testATImpl(uint32_t timeout_ms = 10000L) {
     for (uint32_t start = millis(); millis() - start < timeout_ms;) {
       thisModem().sendAT(GF(""));
       if (thisModem().waitResponse(200) == 1) { return true; }
-      delay(100);
+      thisModem().waitResponse(100, GF("RDY"));
     }
     return false;
   }
 
+  // After a reset command, returns as soon as the modem stops answering so
+  // the next testAT() doesn't reach it before it went down; gives up after
+  // timeout_ms
+  void waitForReset(uint32_t timeout_ms) {
+    for (uint32_t start = millis(); millis() - start < timeout_ms;) {
+      thisModem().sendAT(GF(""));
+      if (thisModem().waitResponse(200) != 1) { return; }
+    }
+  }
+
   String getModemInfoImpl() {
     thisModem().sendAT(GF("I"));
     String res;
@@ -204,6 +485,38 @@ class SimpleNBModem {
     return name;
   }
 
+  // Modems without a settings check always go through the full init
+  bool fastStartImpl() {
+    return false;
+  }
+
+  // Stores the current settings so they are kept over a power cycle
+  bool saveSettingsImpl() {
+    thisModem().sendAT(GF("&W"));
+    return thisModem().waitResponse() == 1;
+  }
+
+  // Runs a query of commands joined by ';' and checks that each expected
+  // reply is in the response; an echo of the query means E0 wasn't kept
+  template <typename... Args>
+  bool checkSettings(GsmConstStr query, Args... expected) {
+    thisModem().sendAT(query);
+    String res;
+    if (thisModem().waitResponse(2000L, res) != 1) { return false; }
+    if (res.indexOf("AT+") >= 0) { return false; }
+    return responseHasAll(res, expected...);
+  }
+
+  static bool responseHasAll(const String& res, const char* last) {
+    return res.indexOf(last) >= 0;
+  }
+
+  template <typename... Args>
+  static bool responseHasAll(const String& res, const char* head,
+                             Args... tail) {
+    return res.indexOf(head) >= 0 && responseHasAll(res, tail...);
+  }
+
   bool factoryDefaultImpl() {
     thisModem().sendAT(GF("&F0Z0E0&W"));  // Factory + Reset + Echo Off + Write
     thisModem().waitResponse();
@@ -261,8 +574,10 @@ class SimpleNBModem {
   SimStatus getSimStatusImpl(uint32_t timeout_ms = 10000L) {
     for (uint32_t start = millis(); millis() - start < timeout_ms;) {
       thisModem().sendAT(GF("+CPIN?"));
-      if (thisModem().waitResponse(GF("+CPIN:")) != 1) {
-        delay(1000);
+      // While the SIM starts up the query fails, the +CPIN: URC then tells
+      // when it is done
+      if (thisModem().waitResponse(GF("+CPIN:")) != 1 &&
+          thisModem().waitResponse(1000L, GF("+CPIN:")) != 1) {
         continue;
       }
       int8_t status =
@@ -307,9 +622,19 @@ class SimpleNBModem {
    * Power functions
    */
  protected:
+  // Some modems answer OK before the radio is off, so the state is read
+  // back until it is 0, for at most the 3 s that used to be waited
   bool radioOffImpl() {
     if (!thisModem().setPhoneFunctionality(0)) { return false; }
-    delay(3000);
+    for (uint32_t start = millis(); millis() - start < 3000L;) {
+      thisModem().sendAT(GF("+CFUN?"));
+      if (thisModem().waitResponse(GF("+CFUN:")) == 1) {
+        int8_t fun = thisModem().streamGetIntBefore('\n');
+        thisModem().waitResponse();
+        if (fun == 0) { return true; }
+      }
+      thisModem().waitResponse(250, GF("+CFUN: 0"));
+    }
     return true;
   }
 
@@ -332,19 +657,174 @@ class SimpleNBModem {
     int8_t resp = thisModem().waitResponse(GF("+CREG:"), GF("+CGREG:"),
                                            GF("+CEREG:"));
     if (resp != 1 && resp != 2 && resp != 3) { return -1; }
-    thisModem().streamSkipUntil(','); /* Skip format (0) */
-    int status = thisModem().stream.parseInt();
+    parseRegistration(resp - 1);
     thisModem().waitResponse();
-    return status;
+    return net.registration[resp - 1];
   }
 
   bool waitForRegistrationImpl(uint32_t timeout_ms   = 60000L, bool check_signal = false) {
     for (uint32_t start = millis(); millis() - start < timeout_ms;) {
       if (check_signal) {
-        while (thisModem().getSignalQuality() == 99) { delay(100); }
+        if (thisModem().getSignalQuality() == 99) {
+          delay(250);
+          continue;
+        }
+        check_signal = false;
       }
       if (thisModem().isNetworkRegistered()) { return true; }
-      delay(250);
+      if (reg_urc && registrationKnown()) {
+        // Nothing to ask, just wait for the modem to say something
+        for (uint32_t t = millis();
+             !thisModem().stream.available() && millis() - t < 250;) {
+          SIMPLE_NB_YIELD();
+        }
+      } else {
+        delay(250);
+      }
+    }
+    return false;
+  }
+
+  // Turns on registration URCs with the area and cell (+CEREG=2 and the
+  // like), after which the registration state is kept without polling
+  bool enableRegistrationUrc(GsmConstStr cmd) {
+    if (sendATSetting(1000L, cmd)) { reg_urc = true; }
+    return reg_urc;
+  }
+
+  // Handles a +CREG, +CGREG, +CEREG or +CSCON URC for waitResponse(),
+  // returns true if data ended with one
+  bool handleRegistrationUrc(const String& data) {
+    if (!data.endsWith(":")) { return false; }
+    int8_t which;
+    if (data.endsWith(GF("+CSCON:"))) {
+      parseConnection();
+      return true;
+    } else if (data.endsWith(GF("+CEREG:"))) {
+      which = 2;
+    } else if (data.endsWith(GF("+CGREG:"))) {
+      which = 1;
+    } else if (data.endsWith(GF("+CREG:"))) {
+      which = 0;
+    } else {
+      return false;
+    }
+    parseRegistration(which);
+    if (!registrationOk()) {
+      net.operator_name = "";
+      net.data          = -1;
+      net.contexts      = 0;
+    }
+    DBG("### Registration:", net.registration[which], "cell", net.cell);
+    return true;
+  }
+
+  // Reads [<n>,]<stat>[,"<tac>","<ci>"[,<AcT>]] up to the end of the line.
+  // A reply to a query has the URC mode <n> in front, a URC doesn't, which
+  // tells them apart even when a URC turns up in place of the reply.
+  void parseRegistration(uint8_t which) {
+    String line = thisModem().stream.readStringUntil('\n');
+    line.trim();
+    int comma = line.indexOf(',');
+    if (comma >= 0 && line[comma + 1] != '"') { line.remove(0, comma + 1); }
+    net.registration[which] = line.toInt();
+    int q = line.indexOf('"');
+    if (q < 0) { return; }
+    net.tac = strtoul(line.c_str() + q + 1, NULL, 16);
+    q       = nextQuoted(line, q);
+    if (q < 0) { return; }
+    net.cell = strtoul(line.c_str() + q + 1, NULL, 16);
+    // With +CEREG=4 the granted PSM active time and periodic TAU follow
+    q = nextQuoted(line, q);
+    if (q < 0) { return; }
+    net.psm_active = strtoul(line.c_str() + q + 1, NULL, 2);
+    q              = nextQuoted(line, q);
+    if (q >= 0) { net.psm_tau = strtoul(line.c_str() + q + 1, NULL, 2); }
+  }
+
+  // Start of the quoted field after the one starting at q, -1 if none
+  static int nextQuoted(const String& line, int q) {
+    int close = line.indexOf('"', q + 1);
+    return close < 0 ? -1 : line.indexOf('"', close + 1);
+  }
+
+  // Data context state after handling the URCs that are waiting, -1 if not
+  // known
+  int8_t dataState() {
+    if (net.data >= 0) { thisModem().streamClear(); }
+    return net.data;
+  }
+
+  void setDataActive(bool active) {
+    if (net.data != active) { DBG("### Data context", active ? "up" : "down"); }
+    net.data = active;
+  }
+
+  // +CSCON: <mode>, the URC form only as the state is never queried
+  void parseConnection() {
+    int8_t rrc = thisModem().stream.readStringUntil('\n').toInt();
+    if (net.rrc == 1 && rrc == 0 && last_uplink) {
+      idle_delay  = millis() - last_uplink;
+      last_uplink = 0;
+    }
+    net.rrc = rrc;
+    DBG("### Connection:", rrc ? "connected" : "idle");
+  }
+
+  // Called by the sockets around a send, the modem's send path reads
+  // uplink_rai and hands it on where it can
+  void startUplink(ReleaseAssist rai) {
+    uplink_rai = rai;
+  }
+  void endUplink() {
+    uplink_rai  = RAI_NONE;
+    last_uplink = millis();
+  }
+
+  // Sends cmd followed by the release assistance of the current send,
+  // unless the modem already has that value
+  bool applyReleaseAssist(GsmConstStr cmd) {
+    if (uplink_rai == applied_rai) { return true; }
+    thisModem().sendAT(cmd, uplink_rai);
+    if (thisModem().waitResponse() != 1) { return false; }
+    applied_rai = uplink_rai;
+    return true;
+  }
+
+  // Pulls DTR low and polls with plain AT until the modem answers, so the
+  // command that follows isn't lost. The SIM70xx needs DTR low for 50 ms.
+  bool wakeFromSleep() {
+    asleep = false;
+    sleep_total += millis() - asleep_since;
+    uint32_t startMillis = millis();
+    dtr_cb(false);
+    delay(50);
+    bool ok = false;
+    while (!ok && millis() - startMillis < SIMPLE_NB_WAKE_TIMEOUT) {
+      thisModem().streamWrite("AT", thisModem().gsmNL);
+      thisModem().stream.flush();
+      ok = thisModem().waitResponse(100) == 1;
+    }
+    wake_latency = millis() - startMillis;
+    wake_count++;
+    DBG("### Wake", ok ? "took" : "failed after", wake_latency, "ms");
+    return ok;
+  }
+
+  void setPsmState(bool entered) {
+    net.psm    = entered;
+    net.psm_at = millis();
+    DBG("### PSM:", entered ? "entered" : "left");
+  }
+
+  bool registrationKnown() {
+    return net.registration[0] >= 0 || net.registration[1] >= 0 || net.registration[2] >= 0;
+  }
+
+  // Registered, home or roaming, on any of CS, GPRS or EPS
+  bool registrationOk() {
+    for (uint8_t i = 0; i < 3; i++) {
+      if (net.registration[i] == 1 || net.registration[i] == 5) { return true; }
     }
     return false;
   }
@@ -388,6 +868,149 @@ class SimpleNBModem {
     return IPAddress(Parts[0], Parts[1], Parts[2], Parts[3]);
   }
 
+  /*
+   * Configuration shadow
+   */
+ protected:
+  // Sends a configuration command and waits for its OK, unless the very same
+  // command already succeeded since the modem was last reset. The command's
+  // name up to its '=' names the setting (or the command without its
+  // trailing digits, as with E0), so a new value replaces the old one.
+  // Returns true when the setting is in place.
+  template <typename... Args>
+  bool sendATSetting(uint32_t timeout_ms, Args... cmd) {
+    return sendATIndexedSetting(timeout_ms, 0, cmd...);
+  }
+
+  // The same for commands whose first parameters pick what is set, e.g. 2
+  // for +QSSLCFG="seclevel",1,0 where the option and the SSL context name
+  // the setting and only the 0 is its value
+  template <typename... Args>
+  bool sendATIndexedSetting(uint32_t timeout_ms, uint8_t indexes,
+                            Args... cmd) {
+    SettingHash hash(indexes);
+    hash.add(cmd...);
+    uint32_t key  = hash.settingKey();
+    uint8_t  slot = settings_next;
+    for (uint8_t i = 0; i < SIMPLE_NB_SETTINGS_SHADOW; i++) {
+      if (settings[i].key != key) { continue; }
+      if (settings[i].value == hash.full) { return true; }
+      slot = i;
+      break;
+    }
+
+    thisModem().sendAT(cmd...);
+    if (thisModem().waitResponse(timeout_ms) != 1) {
+      if (settings[slot].key == key) { settings[slot].key = 0; }
+      return false;
+    }
+    if (slot == settings_next) {
+      settings_next = (settings_next + 1) % SIMPLE_NB_SETTINGS_SHADOW;
+    }
+    settings[slot].key   = key;
+    settings[slot].value = hash.full;
+    return true;
+  }
+
+  // Forgets all applied settings, for when the modem has been reset. The
+  // registration URCs went with them, so does what was learnt from them
+  // (the data context state included, net.data is -1 and net.contexts 0
+  // again), and pending async connects fail.
+  void clearSettingsShadow() {
+    for (uint8_t i = 0; i < SIMPLE_NB_SETTINGS_SHADOW; i++) {
+      settings[i].key = 0;
+    }
+    reg_urc     = false;
+    net         = NetworkState();
+    applied_rai = RAI_NONE;
+    reset_count++;
+  }
+
+  // FNV-1a of a command as sendAT() would write it, the hash of the setting's
+  // name and index parameters is kept apart from the hash of the whole
+  // command
+  class SettingHash : public Print {
+   public:
+    explicit SettingHash(uint8_t indexes) : indexes(indexes) {}
+
+    size_t write(uint8_t c) override {
+      full = (full ^ c) * 16777619UL;
+      if (c == '"') { quoted = !quoted; }
+      if (complete) { return 1; }
+      if (!named) {
+        if (c == '=') {
+          named    = true;
+          key      = full;
+          complete = indexes == 0;
+        } else if (c < '0' || c > '9') {
+          key = full;
+        }
+      } else if (c == ',' && !quoted) {
+        key      = full;
+        complete = --indexes == 0;
+      }
+      return 1;
+    }
+
+    template <typename T>
+    void add(T last) {
+      print(last);
+    }
+
+    template <typename T, typename... Args>
+    void add(T head, Args... tail) {
+      print(head);
+      add(tail...);
+    }
+
+    // A command that ends within its index parameters is a setting of its own
+    uint32_t settingKey() {
+      uint32_t k = named && !complete ? full : key;
+      return k ? k : 1;  // 0 marks a free slot
+    }
+
+    uint32_t full     = 2166136261UL;
+    uint32_t key      = 2166136261UL;
+    uint8_t  indexes;
+    bool     named    = false;
+    bool     quoted   = false;
+    bool     complete = false;
+  };
+
+  struct Setting {
+    uint32_t key;
+    uint32_t value;
+  };
+
+  Setting settings[SIMPLE_NB_SETTINGS_SHADOW] = {};
+  uint8_t settings_next                       = 0;
+  // Bumped on every reset, a connectAsync() pending across one lost its URC
+  uint8_t reset_count = 0;
+
+  bool        flow_control = false;
+  RtsCallback rts_cb       = NULL;
+  bool        rts_ready    = true;
+
+  DtrCallback dtr_cb       = NULL;
+  uint32_t    sleep_idle   = SIMPLE_NB_SLEEP_IDLE;
+  uint32_t    last_command = 0;
+  bool        asleep       = false;
+  uint32_t    asleep_since = 0;
+  uint32_t    sleep_total  = 0;
+  uint32_t    wake_latency = 0;
+  uint16_t    wake_count   = 0;
+
+  uint32_t init_time = 0;  // of the last init(InitMode), in ms
+  bool     init_fast = false;
+
+  bool         reg_urc = false;  // registration is reported by URC
+  NetworkState net;
+
+  ReleaseAssist uplink_rai  = RAI_NONE;  // of the send in progress
+  ReleaseAssist applied_rai = RAI_NONE;  // as last set on the modem
+  uint32_t      last_uplink = 0;
+  uint32_t      idle_delay  = 0;
+
   /*
    Utilities
    */
@@ -0,0 +1,255 @@
+/**
+ * @file       SimpleNBMqtt.tpp
+ * @author     Henry Cheung
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2021 Henry Cheung
+ * @date       Oct 2021
+ */
+
+#ifndef SRC_SIMPLE_NB_MQTT_H_
+#define SRC_SIMPLE_NB_MQTT_H_
+
+#include "SimpleNBCommon.h"
+
+#define SIMPLE_NB_SUPPORT_MQTT
+
+// Bytes of topics and payloads of received messages waiting to be read
+#if !defined(SIMPLE_NB_MQTT_BUFFER)
+#define SIMPLE_NB_MQTT_BUFFER 512
+#endif
+
+// Number of received messages that can wait to be read
+#if !defined(SIMPLE_NB_MQTT_MAX_MESSAGES)
+#define SIMPLE_NB_MQTT_MAX_MESSAGES 4
+#endif
+
+// Keepalive interval the modem pings the broker at, in s
+#if !defined(SIMPLE_NB_MQTT_KEEPALIVE)
+#define SIMPLE_NB_MQTT_KEEPALIVE 60
+#endif
+
+// How long connecting to the broker may take, in ms
+#if !defined(SIMPLE_NB_MQTT_TIMEOUT)
+#define SIMPLE_NB_MQTT_TIMEOUT 60000L
+#endif
+
+// Only built into the modems that support it with SIMPLE_NB_USE_MQTT defined
+// before the modem is included, it costs the message queue below otherwise.
+//
+// The session runs on the modem's own MQTT client, which answers the
+// broker's keepalives by itself. The modem implements:
+//   bool mqttConnectImpl(const char* host, uint16_t port, bool ssl,
+//                        const char* client_id, const char* user,
+//                        const char* pwd);  // with mqtt_keepalive,
+//                                           // mqtt_context and mqtt_ca
+//   void mqttDisconnectImpl();
+//   bool mqttPublishImpl(const char* topic, const uint8_t* payload,
+//                        size_t len, uint8_t qos, bool retain);
+//   bool mqttSubscribeImpl(const char* topic, uint8_t qos);
+//   bool mqttUnsubscribeImpl(const char* topic);
+// hands received messages to queueMqttMessage() or readMqttMessage() from
+// its URC handler and calls setMqttState() when the session is lost. An ssl
+// broker is checked against mqtt_ca, or not at all if that is empty, which
+// mqttConnect() only lets through with mqtt_insecure set.
+
+template <class modemType>
+class SimpleNBMqtt {
+ public:
+  /*
+   * MQTT functions
+   */
+  // Keepalive for the next mqttConnect(), in s
+  void setMqttKeepAlive(uint16_t seconds) {
+    mqtt_keepalive = seconds;
+  }
+
+  // Data context the next mqttConnect() runs on, see activateContext()
+  void setMqttContext(int8_t cid) {
+    mqtt_context = cid;
+  }
+
+  // CA certificate ssl brokers are checked against, in the form the modem's
+  // setCertificate() takes
+  void mqttSetCertificate(const String& certificate) {
+    mqtt_ca = certificate;
+  }
+  // Lets ssl sessions connect without a certificate, so without checking who
+  // the broker is
+  void mqttSetInsecure(bool insecure = true) {
+    mqtt_insecure = insecure;
+  }
+
+  // Fails for an ssl broker with neither mqttSetCertificate() nor
+  // mqttSetInsecure()
+  bool mqttConnect(const char* host, uint16_t port, const char* client_id,
+                   const char* user = NULL, const char* pwd = NULL,
+                   bool ssl = false) {
+    mqttDisconnect();
+    if (ssl && !mqtt_ca.length() && !mqtt_insecure) { return false; }
+    mqtt_connected = thisModem().mqttConnectImpl(host, port, ssl, client_id,
+                                                 user, pwd);
+    return mqtt_connected;
+  }
+
+  void mqttDisconnect() {
+    if (mqtt_connected) { thisModem().mqttDisconnectImpl(); }
+    mqtt_connected = false;
+  }
+
+  // Answered from the state kept from the modem's URCs
+  bool mqttConnected() {
+    thisModem().streamClear();  // a lost session may be waiting
+    return mqtt_connected;
+  }
+
+  bool mqttPublish(const char* topic, const uint8_t* payload, size_t len,
+                   uint8_t qos = 0, bool retain = false) {
+    if (!mqtt_connected) { return false; }
+    return thisModem().mqttPublishImpl(topic, payload, len,
+                                       SimpleNBMin(qos, (uint8_t)2), retain);
+  }
+  bool mqttPublish(const char* topic, const char* payload, uint8_t qos = 0,
+                   bool retain = false) {
+    return mqttPublish(topic, (const uint8_t*)payload, strlen(payload), qos,
+                       retain);
+  }
+
+  // Messages on the topic go to the queue read with mqttRead()
+  bool mqttSubscribe(const char* topic, uint8_t qos = 0) {
+    if (!mqtt_connected) { return false; }
+    return thisModem().mqttSubscribeImpl(topic, SimpleNBMin(qos, (uint8_t)2));
+  }
+  bool mqttUnsubscribe(const char* topic) {
+    if (!mqtt_connected) { return false; }
+    return thisModem().mqttUnsubscribeImpl(topic);
+  }
+
+  // Number of received messages waiting, takes in what the modem sent
+  // meanwhile
+  uint8_t mqttAvailable() {
+    thisModem().streamClear();
+    return mqtt_count;
+  }
+
+  // Takes the oldest received message off the queue and returns the length
+  // of its payload, of which as much as fits buf is copied; -1 if there is
+  // none
+  int mqttRead(String& topic, uint8_t* buf, size_t size) {
+    if (!mqttAvailable()) { return -1; }
+    MqttMessage& m = mqtt_msgs[0];
+    topic          = "";
+    topic.reserve(m.topic_len);
+    for (uint16_t i = 0; i < m.topic_len; i++) {
+      topic += (char)mqtt_buf[i];
+    }
+    if (size) {
+      memcpy(buf, mqtt_buf + m.topic_len, SimpleNBMin(size, (size_t)m.len));
+    }
+    int len = m.len;
+    dropMqttMessage();
+    return len;
+  }
+  // The same with the payload as a String
+  bool mqttRead(String& topic, String& payload) {
+    if (!mqttAvailable()) { return false; }
+    MqttMessage& m = mqtt_msgs[0];
+    payload        = "";
+    payload.reserve(m.len);
+    for (uint16_t i = 0; i < m.len; i++) {
+      payload += (char)mqtt_buf[m.topic_len + i];
+    }
+    return mqttRead(topic, NULL, 0) >= 0;
+  }
+
+  /*
+   * CRTP Helper
+   */
+ protected:
+  inline const modemType& thisModem() const {
+    return static_cast<const modemType&>(*this);
+  }
+  inline modemType& thisModem() {
+    return static_cast<modemType&>(*this);
+  }
+
+  /*
+   * Utilities
+   */
+ protected:
+  void setMqttState(bool connected) {
+    if (mqtt_connected != connected) {
+      DBG("### MQTT", connected ? "connected" : "disconnected");
+    }
+    mqtt_connected = connected;
+  }
+
+  // Queues a received message, dropped if it doesn't fit
+  bool queueMqttMessage(const String& topic, const uint8_t* payload,
+                        size_t len) {
+    if (!reserveMqttMessage(topic, len)) { return false; }
+    memcpy(mqtt_buf + mqtt_used + topic.length(), payload, len);
+    commitMqttMessage(topic, len);
+    return true;
+  }
+
+  // Queues a message whose len bytes of payload are next on the stream; the
+  // payload is read either way so the stream stays in step
+  bool readMqttMessage(const String& topic, size_t len) {
+    bool fits = reserveMqttMessage(topic, len);
+    for (size_t i = 0; i < len; i++) {
+      uint32_t startMillis = millis();
+      while (!thisModem().stream.available() &&
+             (millis() - startMillis < 1000L)) {
+        SIMPLE_NB_YIELD();
+      }
+      int c = thisModem().stream.read();
+      if (fits) { mqtt_buf[mqtt_used + topic.length() + i] = c; }
+    }
+    if (fits) { commitMqttMessage(topic, len); }
+    return fits;
+  }
+
+  // Copies the topic in if topic and payload fit the queue
+  bool reserveMqttMessage(const String& topic, size_t len) {
+    if (mqtt_count >= SIMPLE_NB_MQTT_MAX_MESSAGES ||
+        mqtt_used + topic.length() + len > SIMPLE_NB_MQTT_BUFFER) {
+      DBG("### MQTT message dropped:", topic);
+      return false;
+    }
+    memcpy(mqtt_buf + mqtt_used, topic.c_str(), topic.length());
+    return true;
+  }
+
+  void commitMqttMessage(const String& topic, size_t len) {
+    MqttMessage& m = mqtt_msgs[mqtt_count++];
+    m.topic_len    = topic.length();
+    m.len          = len;
+    // reserveMqttMessage() put the topic in front of the payload
+    mqtt_used += m.topic_len + m.len;
+  }
+
+  void dropMqttMessage() {
+    size_t n = mqtt_msgs[0].topic_len + mqtt_msgs[0].len;
+    memmove(mqtt_buf, mqtt_buf + n, mqtt_used - n);
+    mqtt_used -= n;
+    mqtt_count--;
+    memmove(mqtt_msgs, mqtt_msgs + 1, mqtt_count * sizeof(MqttMessage));
+  }
+
+  struct MqttMessage {
+    uint16_t topic_len;
+    uint16_t len;
+  };
+
+  uint8_t     mqtt_buf[SIMPLE_NB_MQTT_BUFFER];
+  size_t      mqtt_used = 0;
+  MqttMessage mqtt_msgs[SIMPLE_NB_MQTT_MAX_MESSAGES];
+  uint8_t     mqtt_count     = 0;
+  bool        mqtt_connected = false;
+  uint16_t    mqtt_keepalive = SIMPLE_NB_MQTT_KEEPALIVE;
+  int8_t      mqtt_context   = -1;  // -1 for the modem's default
+  String      mqtt_ca;
+  bool        mqtt_insecure = false;
+};
+
+#endif  // SRC_SIMPLE_NB_MQTT_H_
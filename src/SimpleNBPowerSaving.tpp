@@ -0,0 +1,219 @@
+/**
+ * @file       SimpleNBPowerSaving.tpp
+ * @author     Henry Cheung
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2021 Henry Cheung
+ * @date       Oct 2021
+ */
+
+#ifndef SRC_SIMPLE_NB_POWER_SAVING_H_
+#define SRC_SIMPLE_NB_POWER_SAVING_H_
+
+#include "SimpleNBCommon.h"
+
+#define SIMPLE_NB_SUPPORT_POWER_SAVING
+
+// How much earlier than the network nextReachableIn() reports a window, so
+// the host is up and listening by the time the modem wakes
+#if !defined(SIMPLE_NB_PSM_WAKE_MARGIN)
+#define SIMPLE_NB_PSM_WAKE_MARGIN 1000L
+#endif
+
+// Returned by nextReachableIn() when it can't tell
+#define SIMPLE_NB_UNREACHABLE 0xFFFFFFFFUL
+
+// The timers are sent with the standard +CPSMS and +CEDRXS, the modem
+// implements:
+//   bool psmUrcImpl(bool enable);
+// to switch on the URCs it reports entering and leaving PSM with, and calls
+// setPsmState() from waitResponse() when one comes.
+
+template <class modemType>
+class SimpleNBPowerSaving {
+ public:
+  /*
+   * Power saving functions
+   */
+  // Asks the network for PSM with the given periodic TAU and active time in
+  // seconds; the network may grant other values, see getPsmGranted()
+  bool setPsm(bool enable, uint32_t tau_s = 3600, uint32_t active_s = 60) {
+    if (!enable) {
+      thisModem().psmUrcImpl(false);
+      return thisModem().sendATSetting(1000L, GF("+CPSMS=0"));
+    }
+    String tau    = timerBits(psmTimerBits(tau_s, true), 8);
+    String active = timerBits(psmTimerBits(active_s, false), 8);
+    if (!thisModem().sendATSetting(1000L, GF("+CPSMS=1,,,\""), tau,
+                                   GF("\",\""), active, '"')) {
+      return false;
+    }
+    // +CEREG=4 adds the granted timers to the registration report
+    thisModem().enableRegistrationUrc(GF("+CEREG=4"));
+    thisModem().psmUrcImpl(true);
+    return true;
+  }
+
+  // Periodic TAU and active time the network granted, in seconds. Only known
+  // once the modem registered after setPsm().
+  bool getPsmGranted(uint32_t& tau_s, uint32_t& active_s) {
+    const NetworkState& net = thisModem().getNetworkState();
+    if (net.psm_tau == 0xFF || net.psm_active == 0xFF) {
+      thisModem().getRegistrationStatusXREG("CEREG");
+    }
+    if (net.psm_tau == 0xFF || net.psm_active == 0xFF) { return false; }
+    tau_s    = psmTimerSeconds(net.psm_tau, true);
+    active_s = psmTimerSeconds(net.psm_active, false);
+    return tau_s != 0;
+  }
+
+  // Asks for an eDRX cycle of at least cycle_ms on CAT-M or NB-IoT
+  bool setEdrx(bool enable, RadioTech rat, uint32_t cycle_ms = 20480) {
+    if (rat != RADIO_CATM && rat != RADIO_NBIOT) { return false; }
+    uint8_t act = rat == RADIO_NBIOT ? 5 : 4;
+    if (!enable) {
+      edrx_cycle = 0;
+      return thisModem().sendATSetting(1000L, GF("+CEDRXS=0,"), act);
+    }
+    uint8_t code = edrxCode(cycle_ms, rat == RADIO_NBIOT);
+    return thisModem().sendATSetting(1000L, GF("+CEDRXS=1,"), act, GF(",\""),
+                                     timerBits(code, 4), '"');
+  }
+
+  // eDRX cycle and paging time window the network granted, in ms
+  bool getEdrxGranted(uint32_t& cycle_ms, uint32_t& ptw_ms) {
+    // +CEDRXRDP: <act>,"<requested>","<granted>","<ptw>", or just 0 if eDRX
+    // isn't used
+    thisModem().sendAT(GF("+CEDRXRDP"));
+    if (thisModem().waitResponse(GF("+CEDRXRDP:")) != 1) { return false; }
+    String line = thisModem().stream.readStringUntil('\n');
+    thisModem().waitResponse();
+    int  act     = line.toInt();
+    int  granted = line.indexOf('"', line.indexOf('"', line.indexOf('"') + 1) + 1);
+    int  ptw     = line.indexOf('"', line.indexOf('"', granted + 1) + 1);
+    bool nb      = act == 5;
+    if ((act != 4 && !nb) || granted < 0 || ptw < 0) {
+      edrx_cycle = 0;
+      return false;
+    }
+    uint8_t code = strtoul(line.c_str() + granted + 1, NULL, 2);
+    uint8_t win  = strtoul(line.c_str() + ptw + 1, NULL, 2);
+    edrx_cycle   = edrxCycleMs(code);
+    edrx_ptw     = (uint32_t)(win + 1) * (nb ? 2560 : 1280);
+    cycle_ms     = edrx_cycle;
+    ptw_ms       = edrx_ptw;
+    return true;
+  }
+
+  // True while the modem reported it is in PSM and can't be reached
+  bool isInPsm() {
+    return thisModem().getNetworkState().psm;
+  }
+
+  // Milliseconds until downlink data can reach the modem again, less
+  // SIMPLE_NB_PSM_WAKE_MARGIN. 0 if it is reachable now, which with eDRX still
+  // means a delay of up to one cycle, see getEdrxGranted().
+  uint32_t nextReachableIn() {
+    const NetworkState& net = thisModem().getNetworkState();
+    if (!net.psm) { return 0; }
+    uint64_t tau    = (uint64_t)psmTimerSeconds(net.psm_tau, true) * 1000;
+    uint64_t active = (uint64_t)psmTimerSeconds(net.psm_active, false) * 1000;
+    if (!tau || active >= tau) { return SIMPLE_NB_UNREACHABLE; }
+    // The TAU timer started when the modem went idle, an active time before
+    // it entered PSM; after each update it is reachable for the active time
+    uint64_t asleep = (uint32_t)(millis() - net.psm_at);
+    uint64_t wait;
+    if (asleep < tau - active) {
+      wait = tau - active - asleep;
+    } else {
+      uint64_t phase = (asleep - (tau - active)) % tau;
+      wait           = phase < active ? 0 : tau - phase;
+    }
+    if (wait <= SIMPLE_NB_PSM_WAKE_MARGIN) { return 0; }
+    return SimpleNBMin(wait - SIMPLE_NB_PSM_WAKE_MARGIN,
+                       (uint64_t)SIMPLE_NB_UNREACHABLE - 1);
+  }
+
+  // How long the modem stays reachable once a window opens, in ms; the
+  // active time with PSM, the paging time window with eDRX
+  uint32_t reachableWindow() {
+    const NetworkState& net = thisModem().getNetworkState();
+    if (net.psm_active != 0xFF && net.psm_tau != 0xFF) {
+      return psmTimerSeconds(net.psm_active, false) * 1000;
+    }
+    if (edrx_cycle) { return edrx_ptw; }
+    return SIMPLE_NB_UNREACHABLE;
+  }
+
+  /*
+   * CRTP Helper
+   */
+ protected:
+  inline const modemType& thisModem() const {
+    return static_cast<const modemType&>(*this);
+  }
+  inline modemType& thisModem() {
+    return static_cast<modemType&>(*this);
+  }
+
+  /*
+   * Utilities
+   */
+ protected:
+  // PSM timers are three unit bits and a five bit value, the periodic TAU as
+  // GPRS Timer 3 and the active time as GPRS Timer 2 (3GPP TS 24.008). The
+  // smallest unit that holds the time is taken, rounding up.
+  static uint8_t psmTimerBits(uint32_t seconds, bool tau) {
+    static const uint32_t tauUnits[]    = {2, 30, 60, 600, 3600, 36000, 1152000};
+    static const uint8_t  tauCodes[]    = {3, 4, 5, 0, 1, 2, 6};
+    static const uint32_t activeUnits[] = {2, 60, 360};
+    const uint32_t* units = tau ? tauUnits : activeUnits;
+    uint8_t         count = tau ? 7 : 3;
+    for (uint8_t i = 0; i < count; i++) {
+      uint32_t value = (seconds + units[i] - 1) / units[i];
+      if (value <= 31) { return (tau ? tauCodes[i] : i) << 5 | value; }
+    }
+    return (tau ? tauCodes[count - 1] : count - 1) << 5 | 31;
+  }
+
+  // Seconds of a PSM timer, 0 if it is deactivated or not known
+  static uint32_t psmTimerSeconds(uint8_t bits, bool tau) {
+    static const uint32_t tauUnits[]    = {600, 3600, 36000, 2, 30, 60, 1152000};
+    static const uint32_t activeUnits[] = {2, 60, 360};
+    uint8_t unit = bits >> 5;
+    if (bits == 0xFF || unit == 7) { return 0; }
+    // Unknown active time units count as minutes
+    return (tau ? tauUnits[unit] : unit < 3 ? activeUnits[unit] : 60) *
+           (bits & 0x1F);
+  }
+
+  // eDRX cycles are 5.12 s times the value's multiplier
+  static uint32_t edrxCycleMs(uint8_t code) {
+    static const uint16_t mult[] = {1,  2,  4,   8,   12,  16,   20,   24,
+                                    28, 32, 64, 128, 256, 512, 1024, 2048};
+    return (uint32_t)mult[code & 0x0F] * 5120;
+  }
+
+  // Smallest cycle of at least cycle_ms, NB-IoT only has some of them
+  static uint8_t edrxCode(uint32_t cycle_ms, bool nb) {
+    for (uint8_t code = 0; code < 16; code++) {
+      if (nb && (code < 2 || code == 4 || (code > 5 && code < 9))) {
+        continue;
+      }
+      if (edrxCycleMs(code) >= cycle_ms) { return code; }
+    }
+    return 15;
+  }
+
+  static String timerBits(uint8_t value, uint8_t width) {
+    String bits;
+    for (int8_t i = width - 1; i >= 0; i--) {
+      bits += (value >> i) & 1 ? '1' : '0';
+    }
+    return bits;
+  }
+
+  uint32_t edrx_cycle = 0;
+  uint32_t edrx_ptw   = 0;
+};
+
+#endif  // SRC_SIMPLE_NB_POWER_SAVING_H_
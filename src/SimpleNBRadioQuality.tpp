@@ -0,0 +1,135 @@
+/**
+ * @file       SimpleNBRadioQuality.tpp
+ * @author     Henry Cheung
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2021 Henry Cheung
+ * @date       Oct 2021
+ */
+
+#ifndef SRC_SIMPLE_NB_RADIO_QUALITY_H_
+#define SRC_SIMPLE_NB_RADIO_QUALITY_H_
+
+#include "SimpleNBCommon.h"
+
+#define SIMPLE_NB_SUPPORT_RADIO_QUALITY
+
+// How old the values getRadioQuality() returns may get before it asks the
+// modem again, in ms
+#if !defined(SIMPLE_NB_RADIO_REFRESH)
+#define SIMPLE_NB_RADIO_REFRESH 10000L
+#endif
+
+// Weight of a new sample in the smoothed levels, in percent
+#if !defined(SIMPLE_NB_RADIO_SMOOTHING)
+#define SIMPLE_NB_RADIO_SMOOTHING 25
+#endif
+
+// Radio quality of the serving cell. The levels are smoothed over the
+// samples and NAN where the modem doesn't report them, the rest is as last
+// reported.
+typedef struct {
+  float     rsrp       = NAN;  // dBm
+  float     rsrq       = NAN;  // dB
+  float     sinr       = NAN;  // dB
+  int8_t    ce_level   = -1;   // coverage enhancement level 0-2
+  RadioTech rat        = RADIO_NONE;
+  uint32_t  cell       = 0;
+  uint32_t  earfcn     = 0;
+  uint8_t   band       = 0;
+  uint32_t  sampled_at = 0;  // millis() of the last sample
+} RadioQuality_t;
+
+// The modem implements:
+//   bool sampleRadioQualityImpl(RadioQuality_t& sample);
+// filling in what the modem reports of the serving cell right now.
+
+template <class modemType>
+class SimpleNBRadioQuality {
+ public:
+  /*
+   * Radio quality functions
+   */
+  // Smoothed radio quality, the modem is only asked when the values are
+  // older than the refresh interval. Returns false if that failed, q then
+  // still holds the last values, see sampled_at for their age.
+  bool getRadioQuality(RadioQuality_t& q) {
+    bool ok = radio.sampled_at != 0;
+    if (!ok || millis() - radio_checked >= radio_refresh) {
+      ok = refreshRadioQuality();
+    }
+    q = radio;
+    return ok;
+  }
+
+  // Takes a new sample now, whatever its age
+  bool refreshRadioQuality() {
+    RadioQuality_t sample;
+    radio_checked = millis();
+    if (!thisModem().sampleRadioQualityImpl(sample)) { return false; }
+    // The averages start over on another cell
+    if (sample.cell != radio.cell || sample.earfcn != radio.earfcn) {
+      radio.rsrp = radio.rsrq = radio.sinr = NAN;
+    }
+    radio.rsrp       = smooth(radio.rsrp, sample.rsrp);
+    radio.rsrq       = smooth(radio.rsrq, sample.rsrq);
+    radio.sinr       = smooth(radio.sinr, sample.sinr);
+    radio.ce_level   = sample.ce_level;
+    radio.rat        = sample.rat;
+    radio.cell       = sample.cell;
+    radio.earfcn     = sample.earfcn;
+    radio.band       = sample.band;
+    radio.sampled_at = millis();
+    if (!radio.sampled_at) { radio.sampled_at = 1; }
+    return true;
+  }
+
+  // Sets how often getRadioQuality() samples and how much weight in percent
+  // a new sample gets, 100 turns the smoothing off
+  void setRadioQualityRefresh(uint32_t interval_ms,
+                              uint8_t  weight = SIMPLE_NB_RADIO_SMOOTHING) {
+    radio_refresh = interval_ms;
+    radio_weight  = SimpleNBMin(weight, (uint8_t)100);
+  }
+
+  /*
+   * CRTP Helper
+   */
+ protected:
+  inline const modemType& thisModem() const {
+    return static_cast<const modemType&>(*this);
+  }
+  inline modemType& thisModem() {
+    return static_cast<modemType&>(*this);
+  }
+
+  /*
+   * Utilities
+   */
+ protected:
+  float smooth(float avg, float sample) {
+    if (isnan(sample)) { return avg; }
+    if (isnan(avg)) { return sample; }
+    return avg + (sample - avg) * radio_weight / 100;
+  }
+
+  // Field n of a comma separated line, without quotes and spaces
+  static String csvField(const String& line, uint8_t n) {
+    int from = 0;
+    for (uint8_t i = 0; i < n; i++) {
+      from = line.indexOf(',', from) + 1;
+      if (from == 0) { return ""; }
+    }
+    int to = line.indexOf(',', from);
+    String field = line.substring(from, to < 0 ? line.length() : to);
+    field.replace("\"", "");
+    field.trim();
+    return field;
+  }
+
+  RadioQuality_t radio;
+  uint32_t       radio_checked = 0;
+  uint32_t       radio_refresh = SIMPLE_NB_RADIO_REFRESH;
+  uint8_t        radio_weight  = SIMPLE_NB_RADIO_SMOOTHING;
+};
+
+#endif  // SRC_SIMPLE_NB_RADIO_QUALITY_H_
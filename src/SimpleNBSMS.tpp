@@ -51,12 +51,7 @@ class SimpleNBSMS {
     byte   reminder = 0;
     int8_t bitstate = 7;
     for (uint8_t i = 0; i < instr.length(); i += 2) {
-      char buf[4] = {
-          0,
-      };
-      buf[0] = instr[i];
-      buf[1] = instr[i + 1];
-      byte b = strtol(buf, NULL, 16);
+      byte b = SimpleNBHexByte(instr[i], instr[i + 1]);
 
       byte bb = b << (7 - bitstate);
       char c  = (bb + reminder) & 0x7F;
@@ -74,28 +69,22 @@ class SimpleNBSMS {
   }
 
   static inline String SimpleNBDecodeHex8bit(String& instr) {
-    String result;
-    for (uint16_t i = 0; i < instr.length(); i += 2) {
-      char buf[4] = {
-          0,
-      };
-      buf[0] = instr[i];
-      buf[1] = instr[i + 1];
-      char b = strtol(buf, NULL, 16);
-      result += b;
+    String  result;
+    uint8_t bytes[16];
+    result.reserve(instr.length() / 2);
+    for (unsigned i = 0; i + 1 < instr.length(); i += sizeof(bytes) * 2) {
+      size_t n = SimpleNBDecodeHex(
+          instr.c_str() + i,
+          SimpleNBMin((size_t)(instr.length() - i), sizeof(bytes) * 2), bytes);
+      for (size_t j = 0; j < n; j++) { result += (char)bytes[j]; }
     }
     return result;
   }
 
   static inline String SimpleNBDecodeHex16bit(String& instr) {
     String result;
-    for (uint16_t i = 0; i < instr.length(); i += 4) {
-      char buf[4] = {
-          0,
-      };
-      buf[0] = instr[i];
-      buf[1] = instr[i + 1];
-      char b = strtol(buf, NULL, 16);
+    for (unsigned i = 0; i + 3 < instr.length(); i += 4) {
+      char b = SimpleNBHexByte(instr[i], instr[i + 1]);
       if (b) {  // If high byte is non-zero, we can't handle it ;(
 #if defined(SIMPLE_NB_UNICODE_TO_HEX)
         result += "\\x";
@@ -104,9 +93,7 @@ class SimpleNBSMS {
         result += "?";
 #endif
       } else {
-        buf[0] = instr[i + 2];
-        buf[1] = instr[i + 3];
-        b      = strtol(buf, NULL, 16);
+        b = SimpleNBHexByte(instr[i + 2], instr[i + 3]);
         result += b;
       }
     }
@@ -147,11 +134,9 @@ class SimpleNBSMS {
 public:
   String sendUSSDImpl(const String& code) {
     // Set preferred message format to text mode
-    thisModem().sendAT(GF("+CMGF=1"));
-    thisModem().waitResponse();
+    thisModem().sendATSetting(1000L, GF("+CMGF=1"));
     // Set 8-bit hexadecimal alphabet (3GPP TS 23.038)
-    thisModem().sendAT(GF("+CSCS=\"HEX\""));
-    thisModem().waitResponse();
+    thisModem().sendATSetting(1000L, GF("+CSCS=\"HEX\""));
     // Send the message
     thisModem().sendAT(GF("+CUSD=1,\""), code, GF("\""));
     if (thisModem().waitResponse() != 1) { return ""; }
@@ -172,11 +157,9 @@ public:
 
   bool sendSMSImpl(const String& number, const String& text) {
     // Set preferred message format to text mode
-    thisModem().sendAT(GF("+CMGF=1"));
-    thisModem().waitResponse();
+    thisModem().sendATSetting(1000L, GF("+CMGF=1"));
     // Set GSM 7 bit default alphabet (3GPP TS 23.038)
-    thisModem().sendAT(GF("+CSCS=\"GSM\""));
-    thisModem().waitResponse();
+    thisModem().sendATSetting(1000L, GF("+CSCS=\"GSM\""));
     thisModem().sendAT(GF("+CMGS=\""), number, GF("\""));
     if (thisModem().waitResponse(GF(">")) != 1) { return false; }
     thisModem().stream.print(text);  // Actually send the message
@@ -186,12 +169,9 @@ public:
   }
 
   bool sendSMS_UTF8_begin(const char* const number) {
-    thisModem().sendAT(GF("+CMGF=1"));
-    thisModem().waitResponse();
-    thisModem().sendAT(GF("+CSCS=\"HEX\""));
-    thisModem().waitResponse();
-    thisModem().sendAT(GF("+CSMP=17,167,0,8"));
-    thisModem().waitResponse();
+    thisModem().sendATSetting(1000L, GF("+CMGF=1"));
+    thisModem().sendATSetting(1000L, GF("+CSCS=\"HEX\""));
+    thisModem().sendATSetting(1000L, GF("+CSMP=17,167,0,8"));
 
     thisModem().sendAT(GF("+CMGS=\""), number, GF("\""));
     return thisModem().waitResponse(GF(">")) == 1;
@@ -0,0 +1,181 @@
+/**
+ * @file       SimpleNBScheduler.tpp
+ * @author     Henry Cheung
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2021 Henry Cheung
+ * @date       Oct 2021
+ */
+
+#ifndef SRC_SIMPLE_NB_SCHEDULER_H_
+#define SRC_SIMPLE_NB_SCHEDULER_H_
+
+#include "SimpleNBCommon.h"
+
+#define SIMPLE_NB_SUPPORT_SCHEDULER
+
+// Bytes of payload that can wait in the upload queue
+#if !defined(SIMPLE_NB_UPLOAD_BUFFER)
+#define SIMPLE_NB_UPLOAD_BUFFER 512
+#endif
+
+// Number of payloads that can wait in the upload queue
+#if !defined(SIMPLE_NB_MAX_UPLOADS)
+#define SIMPLE_NB_MAX_UPLOADS 8
+#endif
+
+// How long a payload waits for good coverage by default, in ms
+#if !defined(SIMPLE_NB_UPLOAD_MAX_DELAY)
+#define SIMPLE_NB_UPLOAD_MAX_DELAY 600000L
+#endif
+
+// Where the modem doesn't report its CE level the coverage class is taken
+// from the RSRP, CE 0 above the first and CE 2 below the second, in dBm
+#if !defined(SIMPLE_NB_CE1_RSRP)
+#define SIMPLE_NB_CE1_RSRP -110
+#endif
+#if !defined(SIMPLE_NB_CE2_RSRP)
+#define SIMPLE_NB_CE2_RSRP -120
+#endif
+
+// Holds non-urgent payloads back until the coverage is good. It builds on
+// SimpleNBRadioQuality and needs nothing else from the modem, so it is a
+// class of its own on top of the modem rather than part of it, and only
+// takes memory for its queue where one is created:
+//   SimpleNBScheduler<SimpleNB> uploads(modem);
+
+template <class modemType>
+class SimpleNBScheduler {
+ public:
+  explicit SimpleNBScheduler(modemType& modem) : modem(modem) {}
+
+  /*
+   * Upload scheduling functions
+   */
+  // Queues a payload to go out once the coverage class is at most the one
+  // set with setUploadCoverage(), or at the latest after max_delay_ms.
+  // Returns false if it doesn't fit the queue.
+  bool queueUpload(const uint8_t* data, size_t len,
+                   uint32_t max_delay_ms = SIMPLE_NB_UPLOAD_MAX_DELAY) {
+    if (!len || upload_count >= SIMPLE_NB_MAX_UPLOADS ||
+        upload_used + len > SIMPLE_NB_UPLOAD_BUFFER) {
+      return false;
+    }
+    memcpy(upload_buf + upload_used, data, len);
+    Upload& u   = uploads[upload_count++];
+    u.len       = len;
+    u.queued_at = millis();
+    u.max_delay = max_delay_ms;
+    upload_used += len;
+    return true;
+  }
+  bool queueUpload(const char* str,
+                   uint32_t    max_delay_ms = SIMPLE_NB_UPLOAD_MAX_DELAY) {
+    return queueUpload((const uint8_t*)str, strlen(str), max_delay_ms);
+  }
+
+  // Highest coverage class (CE level 0-2) uploads are sent in without
+  // waiting for their deadline, 0 by default
+  void setUploadCoverage(uint8_t max_class) {
+    upload_class = max_class;
+  }
+
+  // True if there is something queued and it should go out now, because
+  // the coverage is good enough or a payload's deadline passed. The radio
+  // quality is answered from its cache, see setRadioQualityRefresh().
+  bool uploadDue() {
+    if (!upload_count) { return false; }
+    int8_t ce = getCoverageClass();
+    if (ce >= 0 && ce <= upload_class) { return true; }
+    for (uint8_t i = 0; i < upload_count; i++) {
+      if (millis() - uploads[i].queued_at >= uploads[i].max_delay) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Writes the queued payloads to a connected client when uploadDue() or
+  // force is set, returns the bytes written. What the client didn't take
+  // stays queued.
+  size_t sendUploads(Client& client, bool force = false) {
+    if (!upload_count || (!force && !uploadDue())) { return 0; }
+    int8_t   ce          = getCoverageClass();
+    uint32_t startMillis = millis();
+    size_t   sent        = 0;
+    while (upload_count) {
+      size_t len = uploads[0].len;
+      size_t n   = client.write(upload_buf, len);
+      sent += n;
+      dropUploadBytes(n);
+      if (n < len) { break; }
+    }
+    if (ce >= 0 && sent) {
+      upload_bytes[ce] += sent;
+      upload_ms[ce] += SimpleNBMax((uint32_t)(millis() - startMillis), (uint32_t)1);
+    }
+    return sent;
+  }
+
+  size_t getQueuedBytes() {
+    return upload_used;
+  }
+
+  void clearUploads() {
+    upload_count = 0;
+    upload_used  = 0;
+  }
+
+  // Average bytes per second sendUploads() achieved in a coverage class,
+  // 0 if nothing was sent in it yet
+  uint32_t getUploadRate(uint8_t ce_class) {
+    if (ce_class > 2 || !upload_ms[ce_class]) { return 0; }
+    return (uint64_t)upload_bytes[ce_class] * 1000 / upload_ms[ce_class];
+  }
+
+  // CE level 0-2 of the serving cell, from the RSRP where the modem doesn't
+  // report it; -1 if not known
+  int8_t getCoverageClass() {
+    RadioQuality_t q;
+    if (!modem.getRadioQuality(q) && !q.sampled_at) { return -1; }
+    if (q.ce_level >= 0) { return SimpleNBMin(q.ce_level, (int8_t)2); }
+    if (isnan(q.rsrp)) { return -1; }
+    if (q.rsrp >= SIMPLE_NB_CE1_RSRP) { return 0; }
+    return q.rsrp >= SIMPLE_NB_CE2_RSRP ? 1 : 2;
+  }
+
+  /*
+   * Utilities
+   */
+ protected:
+  // Takes n bytes off the front of the queue, whole payloads first
+  void dropUploadBytes(size_t n) {
+    if (!n) { return; }
+    memmove(upload_buf, upload_buf + n, upload_used - n);
+    upload_used -= n;
+    while (n && upload_count) {
+      size_t part = SimpleNBMin(n, uploads[0].len);
+      uploads[0].len -= part;
+      n -= part;
+      if (uploads[0].len) { break; }
+      upload_count--;
+      memmove(uploads, uploads + 1, upload_count * sizeof(Upload));
+    }
+  }
+
+  struct Upload {
+    size_t   len;
+    uint32_t queued_at;
+    uint32_t max_delay;
+  };
+
+  modemType& modem;
+  uint8_t    upload_buf[SIMPLE_NB_UPLOAD_BUFFER];
+  size_t     upload_used = 0;
+  Upload     uploads[SIMPLE_NB_MAX_UPLOADS];
+  uint8_t    upload_count    = 0;
+  uint8_t    upload_class    = 0;
+  uint32_t   upload_bytes[3] = {0, 0, 0};
+  uint32_t   upload_ms[3]    = {0, 0, 0};
+};
+
+#endif  // SRC_SIMPLE_NB_SCHEDULER_H_
@@ -21,6 +21,18 @@
 #define SIMPLE_NB_RX_BUFFER 64
 #endif
 
+// Largest read from the modem without flow control, a burst beyond what the
+// host's serial buffer holds could overrun it at high baud rates
+#if !defined(SIMPLE_NB_RX_CHUNK)
+#define SIMPLE_NB_RX_CHUNK 256
+#endif
+
+// Largest read from the modem with flow control, within what every modem's
+// read command returns at once
+#if !defined(SIMPLE_NB_RX_CHUNK_FLOW)
+#define SIMPLE_NB_RX_CHUNK_FLOW 1024
+#endif
+
 // Because of the ordering of resolution of overrides in templates, these need
 // to be written out every time.  This macro is to shorten that.
 #define SIMPLE_NB_CLIENT_CONNECT_OVERRIDES                             \
@@ -50,7 +62,12 @@ class SimpleNBTCP {
    * Basic functions
    */
   void maintain() {
-    return thisModem().maintainImpl();
+    thisModem().maintainImpl();
+    for (int mux = 0; mux < muxCount; mux++) {
+      GsmClient* sock = thisModem().sockets[mux];
+      if (sock) { sock->checkConnectTimeout(); }
+    }
+    thisModem().sleepIfIdle();
   }
 
   /*
@@ -108,11 +125,55 @@ class SimpleNBTCP {
     //   stop(15000L);
     // }
 
+    // Called with the outcome of a connectAsync() once the modem reports it
+    typedef void (*ConnectCallback)(GsmClient& client, bool connected);
+
+    // Starts opening the connection and returns as soon as the modem has
+    // accepted the request, without waiting for the handshake. The outcome
+    // is picked up from the modem's URC by maintain(), after which
+    // connected() and the onConnect() callback reflect it; several sockets
+    // can be opening at the same time this way.
+    // Modems that can only open sockets synchronously override nothing and
+    // fall back to a blocking connect() here.
+    virtual int connectAsync(const char* host, uint16_t port) {
+      int res = connect(host, port);
+      connectDone(res);
+      return res;
+    }
+
+    void onConnect(ConnectCallback callback) {
+      connect_cb = callback;
+    }
+
+    // True while a connectAsync() is still waiting for the modem; an open
+    // that isn't answered within the driver's connect timeout, or that was
+    // pending when the modem reset, fails
+    bool connecting() {
+      if (sock_opening) { at->maintain(); }
+      return sock_opening;
+    }
+
+    // Release assistance for the writes that follow, set RAI_LAST_PACKET
+    // (or RAI_AFTER_REPLY) before the last write so the modem can go idle
+    // without waiting for the network's inactivity timer
+    void setReleaseAssist(ReleaseAssist rai) {
+      this->rai = rai;
+    }
+
+    // Opens the next connections on data context cid, see activateContext();
+    // modems without several contexts ignore it
+    void setContext(uint8_t cid) {
+      context = cid;
+    }
+
     // Writes data out on the client using the modem send functionality
     size_t write(const uint8_t* buf, size_t size) override {
       SIMPLE_NB_YIELD();
       at->maintain();
-      return at->modemSend(buf, size, mux);
+      at->startUplink(rai);
+      size_t sent = at->modemSend(buf, size, mux);
+      at->endUplink();
+      return sent;
     }
 
     size_t write(uint8_t c) override {
@@ -175,6 +236,7 @@ class SimpleNBTCP {
         } /* TODO: Read directly into user buffer? */
         if (!rx.size() && sock_connected) { at->maintain(); }
       }
+      at->updateRts(at->rxFree());
       return cnt;
 
 #elif defined SIMPLE_NB_BUFFER_READ_NO_CHECK
@@ -188,16 +250,19 @@ class SimpleNBTCP {
           buf += chunk;
           cnt += chunk;
           continue;
-        } /* TODO: Read directly into user buffer? */
+        }
         at->maintain();
         if (sock_available > 0) {
-          int n = at->modemRead(SimpleNBMin((uint16_t)rx.free(), sock_available),
-                                mux);
+          size_t got = 0;
+          int    n   = readFromModem(buf, size - cnt, got);
+          buf += got;
+          cnt += got;
           if (n == 0) break;
         } else {
           break;
         }
       }
+      at->updateRts(at->rxFree());
       return cnt;
 
 #elif defined SIMPLE_NB_BUFFER_READ_AND_CHECK_SIZE
@@ -220,16 +285,18 @@ class SimpleNBTCP {
           got_data   = true;
           prev_check = millis();
         }
-        // TODO(vshymanskyy): Read directly into user buffer?
         at->maintain();
         if (sock_available > 0) {
-          int n = at->modemRead(SimpleNBMin((uint16_t)rx.free(), sock_available),
-                                mux);
+          size_t got = 0;
+          int    n   = readFromModem(buf, size - cnt, got);
+          buf += got;
+          cnt += got;
           if (n == 0) break;
         } else {
           break;
         }
       }
+      at->updateRts(at->rxFree());
       return cnt;
 
 #else
@@ -281,6 +348,71 @@ class SimpleNBTCP {
     String remoteIP() SIMPLE_NB_ATTR_NOT_IMPLEMENTED;
 
    protected:
+    // Bytes to ask the modem for, as many as the FIFO and a waiting read()
+    // take. Only a flow controlled UART can be handed more than
+    // SIMPLE_NB_RX_CHUNK at once.
+    uint16_t readChunk() {
+      size_t   room  = rx.free() + direct_len;
+      uint16_t limit = at->isFlowControlEnabled() ? SIMPLE_NB_RX_CHUNK_FLOW
+                                                  : SIMPLE_NB_RX_CHUNK;
+      uint16_t n = SimpleNBMin(room, (size_t)sock_available);
+      return SimpleNBMin(n, limit);
+    }
+
+    // Reads from the modem's buffer for a read() of size bytes. With flow
+    // control the data goes straight into buf, got is how much of it did,
+    // and only what is left over is kept in the FIFO.
+    int readFromModem(uint8_t* buf, size_t size, size_t& got) {
+      bool to_buf = at->isFlowControlEnabled();
+      direct      = buf;
+      direct_len  = to_buf ? size : 0;
+      int n       = at->modemRead(readChunk(), mux);
+      got         = to_buf ? size - direct_len : 0;
+      direct_len  = 0;
+      return n;
+    }
+
+    // Keeps data read off the socket, in the buffer of the read() waiting
+    // for it first
+    size_t put(const uint8_t* data, size_t n) {
+      size_t d = SimpleNBMin(n, direct_len);
+      memcpy(direct, data, d);
+      direct += d;
+      direct_len -= d;
+      return d + rx.put(data + d, (int)(n - d));
+    }
+    bool put(uint8_t c) {
+      return put(&c, 1) == 1;
+    }
+
+    // Marks a connectAsync() as waiting for the modem's URC if the modem
+    // accepted the open, it fails after timeout_s without one
+    int connectStarted(bool accepted, int timeout_s) {
+      sock_opening  = accepted;
+      opening_since = millis();
+      opening_ms    = timeout_s * 1000UL;
+      opening_reset = at->reset_count;
+      return accepted;
+    }
+
+    // Fails a pending connectAsync() whose URC is overdue or was lost with a
+    // modem reset
+    void checkConnectTimeout() {
+      if (!sock_opening) { return; }
+      if (millis() - opening_since > opening_ms ||
+          opening_reset != at->reset_count) {
+        DBG("### Connect timed out on", mux);
+        connectDone(false);
+      }
+    }
+
+    // Marks a connectAsync() as finished, at the request or from the URC
+    void connectDone(bool ok) {
+      sock_opening   = false;
+      sock_connected = ok;
+      if (connect_cb) { connect_cb(*this, ok); }
+    }
+
     // Read and dump anything remaining in the modem's internal buffer.
     // Using this in the client stop() function.
     // The socket will appear open in response to connected() even after it
@@ -294,12 +426,13 @@ class SimpleNBTCP {
       uint32_t startMillis = millis();
       while (sock_available > 0 && (millis() - startMillis < maxWaitMs)) {
         rx.clear();
-        at->modemRead(SimpleNBMin((uint16_t)rx.free(), sock_available), mux);
+        at->modemRead(readChunk(), mux);
       }
       rx.clear();
       at->streamClear();
 
 #elif defined SIMPLE_NB_NO_MODEM_BUFFER
+      (void)maxWaitMs;  // nothing waits on the modem, it pushes all data
       rx.clear();
       at->streamClear();
 
@@ -308,13 +441,26 @@ class SimpleNBTCP {
 #endif
     }
 
-    modemType* at;
-    uint8_t    mux;
-    uint16_t   sock_available;
-    uint32_t   prev_check;
-    bool       sock_connected;
-    bool       got_data;
-    RxFifo     rx;
+    modemType*      at;
+    uint8_t         mux;
+    uint16_t        sock_available;
+    uint32_t        prev_check;
+    bool            sock_connected;
+    bool            got_data;
+    RxFifo          rx;
+    bool            sock_opening = false;
+    uint32_t        opening_since;
+    uint32_t        opening_ms;
+    uint8_t         opening_reset;  // the modem's reset_count at the open
+    ConnectCallback connect_cb   = NULL;
+    ReleaseAssist   rai          = RAI_NONE;
+    int8_t          context      = -1;  // -1 for the modem's default
+    uint8_t*        direct       = NULL;  // the buffer of a waiting read()
+    size_t          direct_len   = 0;
+
+    template <class S, class F>
+    friend size_t SimpleNBReadHexToFifo(S& stream, F* fifo, size_t hexLen,
+                                        uint32_t timeout_ms);
   };
 
   /*
@@ -345,6 +491,46 @@ class SimpleNBTCP {
 #endif
   }
 
+  // Hands the outcome of an open on socket mux to the connectAsync() waiting
+  // for it, from the modem's URC handler or from a blocking open that got
+  // another socket's outcome while waiting for its own
+  void asyncOpenDone(int mux, bool ok) {
+    if (mux < 0 || mux >= muxCount) { return; }
+    GsmClient* sock = thisModem().sockets[mux];
+    if (!sock || !sock->sock_opening) { return; }
+    if (!ok) { thisModem().connectFailed(mux); }
+    sock->connectDone(ok);
+  }
+
+  // Waits for the "<urc> <mux>,<result>" reporting the open of socket mux
+  // and returns its result, -1 if it didn't come in time. Those of sockets
+  // opening with connectAsync() meanwhile go to asyncOpenDone().
+  int16_t waitOpenResult(uint8_t mux, uint32_t timeout_ms, GsmConstStr urc) {
+    modemType& at          = thisModem();
+    uint32_t   startMillis = millis();
+    for (;;) {
+      uint32_t elapsed = millis() - startMillis;
+      if (elapsed >= timeout_ms ||
+          at.waitResponse(timeout_ms - elapsed, urc) != 1) {
+        return -1;
+      }
+      int8_t  id  = at.streamGetIntBefore(',');
+      int16_t res = at.streamGetIntBefore('\n');
+      if (id == mux) { return res; }
+      asyncOpenDone(id, 0 == res);
+    }
+  }
+
+  // Free space of the fullest socket FIFO, RTS goes down when it runs low
+  int rxFree() {
+    int n = SIMPLE_NB_RX_BUFFER;
+    for (int mux = 0; mux < muxCount; mux++) {
+      GsmClient* sock = thisModem().sockets[mux];
+      if (sock) { n = SimpleNBMin(n, sock->rx.free()); }
+    }
+    return n;
+  }
+
   // Yields up to a time-out period and then reads a character from the stream
   // into the mux FIFO
   // TODO(SRGDamia1):  Do we need to wait two _timeout periods for no
@@ -359,7 +545,7 @@ class SimpleNBTCP {
       SIMPLE_NB_YIELD();
     }
     char c = thisModem().stream.read();
-    thisModem().sockets[mux]->rx.put(c);
+    thisModem().sockets[mux]->put(c);
   }
 };
 
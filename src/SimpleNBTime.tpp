@@ -15,6 +15,12 @@
 
 #define SIMPLE_NB_SUPPORT_TIME
 
+// Seconds the time reported by the network is counted on with millis()
+// before the modem's clock is asked again
+#if !defined(SIMPLE_NB_NETWORK_TIME_TTL)
+#define SIMPLE_NB_NETWORK_TIME_TTL 3600
+#endif
+
 typedef struct {
   int year       = 0;
   int month      = 0;
@@ -33,10 +39,19 @@ class SimpleNBTime {
   /*
    * Time functions
    */
+  // Answered without asking the modem when the network has reported the
+  // time recently, in the same format as AT+CCLK
   String getNetworkTime() {
-    return thisModem().getNetworkTimeImpl();
+    DateTime_t dt;
+    if (!reportedNetworkTime(dt)) { return thisModem().getNetworkTimeImpl(); }
+    char res[24];
+    snprintf(res, sizeof(res), "%02d/%02d/%02d,%02d:%02d:%02d%c%02d",
+             dt.year % 100, dt.month, dt.day, dt.hour, dt.minute, dt.second,
+             dt.timezone < 0 ? '-' : '+', abs(dt.timezone));
+    return res;
   }
   bool getNetworkTime(DateTime_t& dt) {
+    if (reportedNetworkTime(dt)) { return true; }
     return thisModem().getNetworkTimeImpl(dt);
   }
 
@@ -82,6 +97,56 @@ class SimpleNBTime {
     thisModem().waitResponse();
     return true;
   }
+
+  /*
+   * Utilities
+   */
+ protected:
+  // Local time from the last time the network reported, moved on by the
+  // time passed since
+  bool reportedNetworkTime(DateTime_t& dt) {
+    const NetworkState& net = thisModem().net;
+    uint32_t            age = (millis() - net.time_at) / 1000;
+    if (!net.has_time || age > SIMPLE_NB_NETWORK_TIME_TTL) { return false; }
+
+    int32_t days = daysFromCivil(net.year, net.month, net.day);
+    int32_t secs = net.hour * 3600L + net.minute * 60L + net.second +
+                   net.timezone * 900L + age;
+    days += secs / 86400L;
+    secs %= 86400L;
+    if (secs < 0) {
+      secs += 86400L;
+      days--;
+    }
+    civilFromDays(days, dt);
+    dt.hour     = secs / 3600;
+    dt.minute   = secs / 60 % 60;
+    dt.second   = secs % 60;
+    dt.timezone = net.timezone;
+    return true;
+  }
+
+  // Days since 1970-01-01 for dates from 2000-03-01 on, counted in years
+  // that start in March so the leap day comes last
+  static int32_t daysFromCivil(int y, int m, int d) {
+    y -= m <= 2;
+    int32_t era = (y - 2000) / 400;
+    int32_t yoe = y - 2000 - era * 400;
+    int32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    return 11017L + era * 146097L + yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  }
+
+  static void civilFromDays(int32_t days, DateTime_t& dt) {
+    int32_t doe = days - 11017L;  // days since 2000-03-01
+    int32_t era = doe / 146097L;
+    doe -= era * 146097L;
+    int32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int32_t mp  = (5 * doy + 2) / 153;
+    dt.day      = doy - (153 * mp + 2) / 5 + 1;
+    dt.month    = mp < 10 ? mp + 3 : mp - 9;
+    dt.year     = 2000 + era * 400 + yoe + (dt.month <= 2);
+  }
 };
 
 #endif  // SRC_SIMPLE_NB_TIME_H_
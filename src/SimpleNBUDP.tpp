@@ -0,0 +1,350 @@
+/**
+ * @file       SimpleNBUDP.tpp
+ * @author     Henry Cheung
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2021 Henry Cheung
+ * @date       Oct 2021
+ */
+
+#ifndef SRC_SIMPLE_NB_UDP_H_
+#define SRC_SIMPLE_NB_UDP_H_
+
+#include "SimpleNBCommon.h"
+
+#define SIMPLE_NB_SUPPORT_UDP
+
+#include "SimpleNBFifo.h"
+
+#if defined(ARDUINO_DASH)
+#include <ArduinoCompat/Udp.h>
+#else
+#include <Udp.h>
+#endif
+
+// Size of the receive buffer, shared by all datagrams waiting to be parsed
+#if !defined(SIMPLE_NB_UDP_RX_BUFFER)
+#define SIMPLE_NB_UDP_RX_BUFFER 256
+#endif
+
+// Largest datagram that can be built between beginPacket() and endPacket()
+#if !defined(SIMPLE_NB_UDP_TX_BUFFER)
+#define SIMPLE_NB_UDP_TX_BUFFER 256
+#endif
+
+// Number of received datagrams that can be queued before parsePacket()
+#if !defined(SIMPLE_NB_UDP_MAX_DATAGRAMS)
+#define SIMPLE_NB_UDP_MAX_DATAGRAMS 4
+#endif
+
+// The modem implements:
+//   bool   modemUdpBegin(uint8_t mux, uint16_t localPort);
+//   size_t modemUdpSend(uint8_t mux, const char* host, uint16_t port,
+//                       const uint8_t* buff, size_t len);
+//   void   modemUdpRead(uint8_t mux);  // queue datagrams waiting on the modem
+//   void   modemUdpStop(uint8_t mux);
+// and keeps the sockets in GsmUdp* udpSockets[muxCount]. A UDP socket takes
+// one of the modem's connection ids, so don't share a mux with a GsmClient.
+
+template <class modemType, uint8_t muxCount>
+class SimpleNBUDP {
+  /*
+   * CRTP Helper
+   */
+ protected:
+  inline const modemType& thisModem() const {
+    return static_cast<const modemType&>(*this);
+  }
+  inline modemType& thisModem() {
+    return static_cast<modemType&>(*this);
+  }
+
+  /*
+   * Inner UDP socket
+   */
+ public:
+  class GsmUdp : public UDP {
+    // Make all classes created from the modem template friends
+    friend class SimpleNBUDP<modemType, muxCount>;
+    friend modemType;
+
+    // Every received datagram keeps its length and sender, its payload sits
+    // in the shared rx FIFO so the boundaries are never lost
+    struct Datagram {
+      uint16_t len;
+      uint8_t  ip[4];
+      uint16_t port;
+    };
+    typedef SimpleNBFifo<uint8_t, SIMPLE_NB_UDP_RX_BUFFER>           RxFifo;
+    typedef SimpleNBFifo<Datagram, SIMPLE_NB_UDP_MAX_DATAGRAMS + 1> DatagramFifo;
+
+   public:
+    GsmUdp() {}
+
+    explicit GsmUdp(modemType& modem, uint8_t mux = 0) {
+      init(&modem, mux);
+    }
+
+    // The mux is the modem's own connection id, on modems that number them
+    // from 1 the last one shares slot 0 of udpSockets
+    bool init(modemType* modem, uint8_t mux = 0) {
+      this->at    = modem;
+      this->mux   = mux;
+      sock_open   = false;
+      got_data    = false;
+      prev_check  = 0;
+      local_port  = 0;
+      remote_port = 0;
+      remaining   = 0;
+      tx_len      = 0;
+      tx_overflow = false;
+      peer_port   = 0;
+      at->udpSockets[mux % muxCount] = this;
+      return true;
+    }
+
+    // Opens the socket, on modems that can only talk to a single peer per
+    // socket the connection is made by endPacket()
+    uint8_t begin(uint16_t port) override {
+      stop();
+      local_port = port;
+      sock_open  = at->modemUdpBegin(mux, port);
+      return sock_open;
+    }
+
+    void stop() override {
+      if (sock_open) { at->modemUdpStop(mux); }
+      sock_open   = false;
+      remaining   = 0;
+      tx_len      = 0;
+      tx_overflow = false;
+      peer_port   = 0;
+      rx.clear();
+      datagrams.clear();
+    }
+
+    int beginPacket(IPAddress ip, uint16_t port) override {
+      return beginPacket(SimpleNBStringFromIp(ip).c_str(), port);
+    }
+
+    int beginPacket(const char* host, uint16_t port) override {
+      tx_host = host;
+      tx_port     = port;
+      tx_len      = 0;
+      tx_overflow = false;
+      return 1;
+    }
+
+    // Fails without sending if the datagram outgrew SIMPLE_NB_UDP_TX_BUFFER,
+    // a truncated datagram is never sent
+    int endPacket() override {
+      if (!sock_open) { return 0; }
+      size_t len  = tx_len;
+      bool   over = tx_overflow;
+      tx_len      = 0;
+      tx_overflow = false;
+      if (over) {
+        DBG("### UDP datagram too large for SIMPLE_NB_UDP_TX_BUFFER");
+        return 0;
+      }
+      SIMPLE_NB_YIELD();
+      at->maintain();
+      at->startUplink(rai);
+      size_t sent = at->modemUdpSend(mux, tx_host.c_str(), tx_port, tx_buf, len);
+      at->endUplink();
+      return sent == len;
+    }
+
+    // Sends the datagram with release assistance for this one only, e.g.
+    // RAI_LAST_PACKET for the last report before sleeping
+    int endPacket(ReleaseAssist once) {
+      ReleaseAssist sticky = rai;
+      rai                  = once;
+      int res              = endPacket();
+      rai                  = sticky;
+      return res;
+    }
+
+    // Release assistance for every datagram that follows
+    void setReleaseAssist(ReleaseAssist rai) {
+      this->rai = rai;
+    }
+
+    // Opens the socket on data context cid from the next begin() on, see
+    // activateContext(); modems without several contexts ignore it
+    void setContext(uint8_t cid) {
+      context = cid;
+    }
+
+    // Data is collected until endPacket() so it goes out as one datagram.
+    // Returns the bytes that fit, short of size once the datagram is full;
+    // endPacket() then fails.
+    size_t write(const uint8_t* buf, size_t size) override {
+      size_t n = SimpleNBMin(size, sizeof(tx_buf) - tx_len);
+      memcpy(tx_buf + tx_len, buf, n);
+      tx_len += n;
+      if (n < size) { tx_overflow = true; }
+      return n;
+    }
+
+    size_t write(uint8_t c) override {
+      return write(&c, 1);
+    }
+
+    size_t write(const char* str) {
+      if (str == NULL) return 0;
+      return write((const uint8_t*)str, strlen(str));
+    }
+
+    // Moves on to the next datagram, returns its size or 0 if there is none
+    int parsePacket() override {
+      // Whatever was not read of the current datagram is dropped
+      while (remaining) {
+        uint8_t buf[16];
+        remaining -= rx.get(buf, SimpleNBMin(remaining, (uint16_t)sizeof(buf)));
+      }
+      SIMPLE_NB_YIELD();
+      if (!datagrams.readable() && sock_open) {
+        // Some modules "forget" to notify about data arrival
+        if (millis() - prev_check > 500) {
+          got_data   = true;
+          prev_check = millis();
+        }
+        at->maintain();
+        if (got_data) {
+          got_data = false;
+          at->modemUdpRead(mux);
+        }
+      }
+      Datagram d;
+      if (!datagrams.get(&d)) { return 0; }
+      remaining   = d.len;
+      remote_ip   = IPAddress(d.ip);
+      remote_port = d.port;
+      return d.len;
+    }
+
+    int available() override {
+      return remaining;
+    }
+
+    int read(uint8_t* buf, size_t size) override {
+      int n = rx.get(buf, SimpleNBMin(size, (size_t)remaining));
+      remaining -= n;
+      return n;
+    }
+
+    int read(char* buf, size_t size) override {
+      return read(reinterpret_cast<uint8_t*>(buf), size);
+    }
+
+    int read() override {
+      uint8_t c;
+      if (read(&c, 1) == 1) { return c; }
+      return -1;
+    }
+
+    int peek() override {
+      if (!remaining) { return -1; }
+      return rx.peek();
+    }
+
+    void flush() override {
+      at->stream.flush();
+    }
+
+    IPAddress remoteIP() override {
+      return remote_ip;
+    }
+
+    uint16_t remotePort() override {
+      return remote_port;
+    }
+
+    static inline String SimpleNBStringFromIp(IPAddress ip) {
+      String host;
+      host.reserve(16);
+      host += ip[0];
+      host += ".";
+      host += ip[1];
+      host += ".";
+      host += ip[2];
+      host += ".";
+      host += ip[3];
+      return host;
+    }
+
+   protected:
+    modemType*   at;
+    uint8_t      mux;
+    bool         sock_open;
+    bool         got_data;
+    uint32_t     prev_check;
+    uint16_t     local_port;
+    IPAddress    remote_ip;
+    uint16_t     remote_port;
+    uint16_t     remaining;
+    RxFifo       rx;
+    DatagramFifo datagrams;
+    String       tx_host;
+    uint16_t     tx_port;
+    uint8_t      tx_buf[SIMPLE_NB_UDP_TX_BUFFER];
+    size_t       tx_len;
+    bool         tx_overflow;  // write() ran out of tx_buf
+    // Peer of the modem's socket, on modems where a UDP socket is opened
+    // towards a single remote; a peer_port of 0 means not opened yet
+    String       peer_host;
+    uint16_t     peer_port;
+    ReleaseAssist rai = RAI_NONE;  // for every datagram, see endPacket()
+    int8_t       context = -1;     // -1 for the modem's default
+  };
+
+  /*
+   * Utilities
+   */
+ protected:
+  // Moves the socket to the id the modem picked. A GsmUdp already holding
+  // that id isn't open, or the modem would not have handed the id out, so it
+  // takes the slot given up instead of being lost.
+  void moveUdpSocket(uint8_t from, uint8_t to) {
+    GsmUdp* other                   = thisModem().udpSockets[to];
+    thisModem().udpSockets[to]      = thisModem().udpSockets[from];
+    thisModem().udpSockets[from]    = other;
+    thisModem().udpSockets[to]->mux = to;
+    if (other) { other->mux = from; }
+  }
+
+  // Reads a datagram of len bytes from the stream into the socket's FIFO,
+  // taking two hex characters per byte if hex is set.
+  // A datagram that does not fit as a whole is read and dropped, so what is
+  // queued always starts on a datagram boundary.
+  void moveDatagramFromStreamToFifo(uint8_t mux, size_t len, IPAddress ip,
+                                    uint16_t port, bool hex = false) {
+    GsmUdp* udp = thisModem().udpSockets[mux % muxCount];
+    bool    fits =
+        udp && udp->datagrams.writeable() && udp->rx.free() >= (int)len;
+    for (size_t i = 0; i < len; i++) {
+      uint32_t startMillis = millis();
+      while (thisModem().stream.available() < (hex ? 2 : 1) &&
+             (millis() - startMillis < 1000L)) {
+        SIMPLE_NB_YIELD();
+      }
+      char c = thisModem().stream.read();
+      if (hex) { c = SimpleNBHexByte(c, thisModem().stream.read()); }
+      if (fits) { udp->rx.put(c); }
+    }
+    if (!fits) {
+      DBG("### UDP datagram dropped:", len, "on", mux);
+      return;
+    }
+    typename GsmUdp::Datagram d;
+    d.len   = len;
+    d.ip[0] = ip[0];
+    d.ip[1] = ip[1];
+    d.ip[2] = ip[2];
+    d.ip[3] = ip[3];
+    d.port  = port;
+    udp->datagrams.put(d);
+  }
+};
+
+#endif  // SRC_SIMPLE_NB_UDP_H_
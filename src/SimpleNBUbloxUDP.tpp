@@ -0,0 +1,114 @@
+/**
+ * @file       SimpleNBUbloxUDP.tpp
+ * @author     Henry Cheung
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2021 Henry Cheung
+ * @date       Oct 2021
+ */
+
+#ifndef SRC_SIMPLE_NB_UBLOX_UDP_H_
+#define SRC_SIMPLE_NB_UBLOX_UDP_H_
+
+#include "SimpleNBCommon.h"
+
+// UDP on the u-blox socket commands (+USOCR, +USOST, +USORF, +USOCL), the
+// same on the SARA R4 and the older u-blox modules. The modem includes
+// SimpleNBUDP.tpp and SimpleNBDNS.tpp as well and sets got_data on its
+// +UUSORF URC.
+
+template <class modemType>
+class SimpleNBUbloxUDP {
+  /*
+   * CRTP Helper
+   */
+ protected:
+  inline const modemType& thisModem() const {
+    return static_cast<const modemType&>(*this);
+  }
+  inline modemType& thisModem() {
+    return static_cast<modemType&>(*this);
+  }
+
+  /*
+   * UDP functions
+   */
+ protected:
+  // UDP sockets are not tied to a peer, each datagram carries its own
+  // destination and is read back with its sender. The modem picks the socket
+  // number, the GsmUdp is moved to it.
+  bool modemUdpBegin(uint8_t mux, uint16_t localPort) {
+    modemType& at = thisModem();
+    // AT+USOCR=17[,<local_port>]
+    if (localPort) {
+      at.sendAT(GF("+USOCR=17,"), localPort);
+    } else {
+      at.sendAT(GF("+USOCR=17"));
+    }
+    if (at.waitResponse(GF("\r\n+USOCR:")) != 1) { return false; }
+    uint8_t id = at.streamGetIntBefore('\n');
+    at.waitResponse();
+    if (id >= SIMPLE_NB_MUX_COUNT) { return false; }
+    if (id != mux) {
+      DBG("WARNING:  Mux number changed from", mux, "to", id);
+      at.moveUdpSocket(mux, id);
+    }
+    return true;
+  }
+
+  // The modem only takes an IP address for the remote, names are resolved
+  size_t modemUdpSend(uint8_t mux, const char* host, uint16_t port,
+                      const uint8_t* buff, size_t len) {
+    modemType& at = thisModem();
+    String     ip = at.resolve(host);
+    if (!ip.length()) { return 0; }
+    // AT+USOST=<socket>,<remote_ip_addr>,<remote_port>,<length>
+    at.sendAT(GF("+USOST="), mux, GF(",\""), ip, GF("\","), port, ',',
+              (uint16_t)len);
+    if (at.waitResponse(GF("@")) != 1) { return 0; }
+    // 50ms delay, see AT manual section 25.10.4
+    delay(50);
+    at.stream.write(buff, len);
+    at.stream.flush();
+    if (at.waitResponse(GF("\r\n+USOST:")) != 1) { return 0; }
+    at.streamSkipUntil(',');  // Skip mux
+    int16_t sent = at.streamGetIntBefore('\n');
+    at.waitResponse();
+    return SimpleNBMax(sent, (int16_t)0);
+  }
+
+  void modemUdpRead(uint8_t mux) {
+    modemType& at = thisModem();
+    // Each AT+USORF returns a single datagram
+    // +USORF: <socket>,<remote_ip_addr>,<remote_port>,<length>,"<data>"
+    for (int i = 0; i < SIMPLE_NB_UDP_MAX_DATAGRAMS; i++) {
+      at.sendAT(GF("+USORF="), mux, GF(",1024"));
+      if (at.waitResponse(GF("\r\n+USORF:")) != 1) { return; }
+      at.streamSkipUntil(',');  // Skip mux
+      if (at.stream.peek() != '"') {
+        // Nothing waiting, the reply is just the length 0
+        at.streamSkipUntil('\n');
+        at.waitResponse();
+        return;
+      }
+      at.streamSkipUntil('"');
+      String    remote = at.stream.readStringUntil('"');
+      IPAddress ip;
+      ip.fromString(remote.c_str());
+      at.streamSkipUntil(',');
+      uint16_t rport = at.streamGetIntBefore(',');
+      int16_t  len   = at.streamGetIntBefore(',');
+      at.streamSkipUntil('"');
+      at.moveDatagramFromStreamToFifo(mux, SimpleNBMax(len, (int16_t)0), ip,
+                                      rport);
+      at.streamSkipUntil('"');
+      at.waitResponse();
+    }
+  }
+
+  void modemUdpStop(uint8_t mux) {
+    thisModem().sendAT(GF("+USOCL="), mux);
+    thisModem().waitResponse();
+  }
+};
+
+#endif  // SRC_SIMPLE_NB_UBLOX_UDP_H_
@@ -0,0 +1,94 @@
+/**************************************************************
+ *
+ * This sketch times the decoding of hex payloads, as received
+ * with SIMPLE_NB_USE_HEX and from SIM7020 URCs, per byte on
+ * your board. It compares the table driven decoder the library
+ * uses against the strtol() loop it replaced.
+ * No modem is needed, the hex comes from memory.
+ *
+ * SimpleNB README:
+ *   https://github.com/techstudio-design/SimpleNB/blob/master/README.md
+ *
+ **************************************************************/
+
+#include <SimpleNBCommon.h>
+#include <SimpleNBFifo.h>
+
+// Payload bytes decoded per run
+#define BENCH_BYTES 4096
+
+// Hands out the same hex string over and over, like a modem that always
+// has the next characters buffered
+class HexStream : public Stream {
+ public:
+  int available() override {
+    return 64;
+  }
+  int read() override {
+    char c = hex[pos++];
+    if (!hex[pos]) { pos = 0; }
+    return c;
+  }
+  int peek() override {
+    return hex[pos];
+  }
+  void flush() override {}
+  size_t write(uint8_t) override {
+    return 1;
+  }
+
+ private:
+  const char* hex = "48656C6C6F2C20776F726C64210D0A00FFa5c3";
+  size_t      pos = 0;
+};
+
+HexStream                          source;
+SimpleNBFifo<uint8_t, 256>         fifo;
+uint8_t                            drain[256];
+volatile uint8_t                   sink;
+
+// The per byte loop the receive paths used before
+void decodeStrtol(size_t bytes) {
+  for (size_t i = 0; i < bytes; i++) {
+    char buf[4] = {0};
+    buf[0]      = source.read();
+    buf[1]      = source.read();
+    fifo.put((uint8_t)strtol(buf, NULL, 16));
+    if (!fifo.free()) { fifo.get(drain, sizeof(drain)); }
+  }
+}
+
+// The library's block decoder straight into the FIFO
+void decodeTable(size_t bytes) {
+  while (bytes) {
+    size_t n = SimpleNBMin(bytes, (size_t)(fifo.free()));
+    SimpleNBReadHexToFifo(source, &fifo, n * 2, 1000L);
+    bytes -= n;
+    fifo.get(drain, sizeof(drain));
+  }
+}
+
+void report(const char* name, uint32_t us) {
+  Serial.print(name);
+  Serial.print(F(": "));
+  Serial.print((float)us * 1000 / BENCH_BYTES);
+  Serial.println(F(" ns/byte"));
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(10);
+
+  uint32_t start = micros();
+  decodeStrtol(BENCH_BYTES);
+  report("strtol loop", micros() - start);
+
+  fifo.clear();
+  start = micros();
+  decodeTable(BENCH_BYTES);
+  report("nibble table", micros() - start);
+
+  sink = drain[0];
+}
+
+void loop() {}
@@ -16,6 +16,9 @@
 // #define SIMPLE_NB_MODEM_SEQUANS_MONARCH
 // #define SIMPLE_NB_MODEM_XBEE
 
+#define SIMPLE_NB_USE_HTTP
+#define SIMPLE_NB_USE_MQTT
+
 #include <SimpleNBClient.h>
 
 SimpleNB modem(Serial);
@@ -23,6 +26,11 @@ SimpleNB modem(Serial);
 void setup() {
   Serial.begin(115200);
   delay(6000);
+  SimpleNBBegin(Serial, 115200);
+  SimpleNBAutoBaud(Serial, 9600, 115200, 57600);
+  modem.negotiateMaxBaud(Serial, 115200, 921600, true);
+  modem.setFlowControl(true);
+  modem.isFlowControlEnabled();
 }
 
 void loop() {
@@ -31,6 +39,10 @@ void loop() {
   modem.begin("1234");
   modem.init();
   modem.init("1234");
+  modem.init(INIT_FAST_START);
+  modem.init(INIT_FAST_START, "1234");
+  modem.getInitTime();
+  modem.isFastStart();
   modem.setBaud(115200);
   modem.testAT();
 
@@ -41,6 +53,11 @@ void loop() {
   // Test Power functions
   modem.restart();
   // modem.sleepEnable();  // Not available for all modems
+  modem.setSleepManager(NULL, 5000L);
+  modem.sleepIfIdle();
+  modem.getSleepTime();
+  modem.getWakeLatency();
+  modem.getWakeCount();
   // modem.radioOff();  // Not available for all modems
   modem.powerOff();
 
@@ -50,6 +67,9 @@ void loop() {
   modem.waitForRegistration();
   modem.waitForRegistration(15000L);
   modem.waitForRegistration(15000L, true);
+  modem.getTrackingAreaCode();
+  modem.getCellId();
+  modem.getNetworkState().operator_name;
   modem.getSignalQuality();
   modem.getLocalIP();
   modem.localIP();
@@ -85,6 +105,7 @@ void loop() {
   // Make a HTTP GET request:
   client.print(String("GET ") + resource + " HTTP/1.0\r\n");
   client.print(String("Host: ") + server + "\r\n");
+  client.setReleaseAssist(RAI_AFTER_REPLY);
   client.print("Connection: close\r\n\r\n");
 
   uint32_t timeout = millis();
@@ -97,6 +118,10 @@ void loop() {
 
   client.stop();
 
+  client3.connectAsync(server, 80);
+  while (client3.connecting()) {}
+  client3.stop();
+
 #if defined(SIMPLE_NB_SUPPORT_SSL)
   // modem.addCertificate();  // not yet impemented
   SimpleNBClientSecure client_secure(modem);
@@ -123,6 +148,132 @@ void loop() {
   client_secure.stop();
 #endif
 
+#if defined(SIMPLE_NB_SUPPORT_UDP)
+  SimpleNBUdp udp(modem, 2);
+  udp.begin(5683);
+  udp.beginPacket(IPAddress(1, 2, 3, 4), 5683);
+  udp.write((const uint8_t*)"ping", 4);
+  udp.endPacket();
+  udp.setReleaseAssist(RAI_NONE);
+  udp.beginPacket(IPAddress(1, 2, 3, 4), 5683);
+  udp.write((const uint8_t*)"last", 4);
+  udp.endPacket(RAI_LAST_PACKET);
+  modem.enableConnectionUrc();
+  modem.getIdleDelay();
+  if (udp.parsePacket()) {
+    udp.remoteIP();
+    udp.remotePort();
+    while (udp.available()) { udp.read(); }
+  }
+  udp.stop();
+#endif
+
+#if defined(SIMPLE_NB_SUPPORT_CONTEXTS)
+  modem.setContextApn(2, "myPrivateAPN");
+  modem.setContextApn(2, "myPrivateAPN", "myAPNUser", "myAPNPass");
+  modem.activateContext(2);
+  modem.isContextActive(2);
+  modem.getContextIP(2);
+  client.setContext(2);
+  client.connect(server, 80);
+  client.stop();
+  modem.deactivateContext(2);
+#endif
+
+#if defined(SIMPLE_NB_SUPPORT_DNS)
+  modem.resolve(server);
+  modem.resolve(server, 15000L, 1);
+  modem.getDnsCacheHits();
+  modem.getDnsCacheMisses();
+  modem.getDnsCacheHitRate();
+  modem.clearDnsCache();
+#endif
+
+#if defined(SIMPLE_NB_SUPPORT_BANDS)
+  uint8_t bands[] = {3, 8, 20};
+  modem.setBands(RADIO_NBIOT, bands, 3);
+  modem.getBands(RADIO_NBIOT, bands, 3);
+  uint64_t mask[2];
+  modem.getBandMask(RADIO_NBIOT, mask);
+  modem.setBandMask(RADIO_NBIOT, mask);
+  modem.setScanSequence(RADIO_NBIOT, RADIO_CATM);
+  AttachInfo_t cell;
+  modem.getServingCell(cell);
+  modem.setLastAttach(modem.getLastAttach());
+  modem.waitForAttach(60000L);
+#endif
+
+#if defined(SIMPLE_NB_SUPPORT_RADIO_QUALITY)
+  RadioQuality_t radio;
+  modem.setRadioQualityRefresh(5000L, 50);
+  modem.getRadioQuality(radio);
+  modem.refreshRadioQuality();
+#endif
+
+#if defined(SIMPLE_NB_SUPPORT_SCHEDULER)
+  SimpleNBUploadScheduler uploads(modem);
+  uploads.setUploadCoverage(1);
+  uploads.queueUpload("reading", 60000L);
+  uploads.queueUpload((const uint8_t*)"raw", 3);
+  if (uploads.uploadDue()) {
+    client.connect(server, 80);
+    uploads.sendUploads(client);
+    client.stop();
+  }
+  uploads.sendUploads(client, true);
+  uploads.getQueuedBytes();
+  uploads.getCoverageClass();
+  uploads.getUploadRate(0);
+  uploads.clearUploads();
+#endif
+
+#if defined(SIMPLE_NB_SUPPORT_HTTP)
+  modem.httpSetCertificate("UFS:ca.pem");
+  modem.httpSetInsecure(false);
+  modem.httpAddHeader("Accept", "application/json");
+  modem.httpGet("http://vsh.pp.ua/SimpleNB/logo.txt");
+  modem.httpContentLength();
+  modem.httpHeader("Content-Type");
+  uint8_t body[32];
+  modem.httpRead(body, sizeof(body));
+  modem.httpReadString();
+  modem.httpPost("https://example.com/data", "{\"t\":21}", "application/json");
+  modem.httpPost("https://example.com/raw", body, sizeof(body));
+  modem.httpEnd();
+#endif
+
+#if defined(SIMPLE_NB_SUPPORT_MQTT)
+  modem.setMqttKeepAlive(300);
+  modem.setMqttContext(1);
+  modem.mqttSetCertificate("UFS:ca.pem");
+  modem.mqttSetInsecure(false);
+  modem.mqttConnect("test.mosquitto.org", 1883, "SimpleNB");
+  modem.mqttConnect("test.mosquitto.org", 8884, "SimpleNB", "user", "pass", true);
+  modem.mqttSubscribe("SimpleNB/led", 1);
+  modem.mqttPublish("SimpleNB/init", "started");
+  modem.mqttPublish("SimpleNB/raw", (const uint8_t*)"\x01\x02", 2, 1, true);
+  if (modem.mqttAvailable()) {
+    String  topic, payload;
+    uint8_t msg[32];
+    modem.mqttRead(topic, msg, sizeof(msg));
+    modem.mqttRead(topic, payload);
+  }
+  modem.mqttConnected();
+  modem.mqttUnsubscribe("SimpleNB/led");
+  modem.mqttDisconnect();
+#endif
+
+#if defined(SIMPLE_NB_SUPPORT_POWER_SAVING)
+  modem.setPsm(true, 3600, 60);
+  uint32_t tau, active;
+  modem.getPsmGranted(tau, active);
+  modem.setEdrx(true, RADIO_NBIOT, 20480);
+  modem.getEdrxGranted(tau, active);
+  modem.isInPsm();
+  modem.nextReachableIn();
+  modem.reachableWindow();
+#endif
+
 // Test the calling functions
 #if defined(SIMPLE_NB_SUPPORT_CALLING) && not defined(__AVR_ATmega32U4__)
   modem.callNumber(String("+380000000000"));